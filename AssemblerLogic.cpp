@@ -1,511 +1,615 @@
 #include"AssemblerLogic.h"
-#include "qregularexpression.h"
+#include <QDir>
+#include <QtEndian>
+#include <atomic>
 
 
+static std::atomic<int> fileReads{0};
+static thread_local AsmIncbinFiles *currentIncbinFiles = nullptr;
 
+static QString toQString(std::string_view text)
+{
+    return QString::fromUtf8(text.data(), static_cast<int>(text.size()));
+}
 
-QVector<QString> readLinesFromFile(const QString &filename)
+static bool hasLabel(const AsmSymbolTable &labels, const AsmToken &token)
 {
-    QVector<QString> lines;
-    QFile file(filename);
-    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
-    {
-        QMessageBox::critical(nullptr, "Error", "Cannot open file for reading: " + file.errorString());
-        return lines;
-    }
-    QTextStream in(&file);
-    while (!in.atEnd())
-    {
-        QString line = in.readLine();
-        lines.append(line.trimmed());
-    }
-    file.close(); // Always close the file after reading
-    return lines;
+    return labels.contains(token.text);
 }
 
-//labels and their corresponding memory addresses
-QMap<QString, uint16_t> processLabels(const QVector<QString> &lines)
+static uint16_t labelAddress(const AsmSymbolTable &labels, const AsmToken &token)
 {
-    QMap<QString, uint16_t> labels;
-    uint16_t address = 0x3000; // Starting address
-    for (const QString &line : lines)
-    {
-        if (line.isEmpty() || line.startsWith(';'))
-            continue; // Ignore empty lines and comments
+    return labels.value(token.text);
+}
+
+static bool isDirective(AsmTokens tokens, Lc3EntryKind kind)
+{
+    const Lc3InstructionDesc *desc = lc3FindMnemonic(tokens[0].text);
+    return desc && desc->kind == kind;
+}
+
+// EXPORT and IMPORT only matter when linking modules; a single source ignores them
+static bool isLinkageDirective(AsmTokens tokens)
+{
+    return isDirective(tokens, Lc3EntryKind::Export) || isDirective(tokens, Lc3EntryKind::Import);
+}
 
-        QRegularExpression re("\\s+");
-        QVector<QString> tokens = line.split(re, Qt::SkipEmptyParts);
-        if (tokens[0] == "ORG")
+// A whole 16-bit data word in any immediate form
+static bool parseDataWord(std::string_view text, int &value)
+{
+    return asmParseImmediate(text, value) && value >= -32768 && value <= 0xFFFF;
+}
+
+bool expandBlockDirective(AsmTokens tokens, AsmBlock &block, QString &error)
+{
+    block = AsmBlock();
+    std::string_view mnemonic = tokens[0].text;
+    int value = 0;
+    if (mnemonic == ".BLKW")
+    {
+        if (tokens.size() < 2 || tokens.size() > 3 || !asmParseImmediate(tokens[1].text, value) || value < 1
+            || value > int(LC3Memory::Size))
         {
-            QString addrString = tokens[1];
-            bool ok;
-            uint16_t newAddress = addrString.toInt(&ok, 16);
-            if (!ok)
-            {
-                QMessageBox::critical(nullptr, "Error", "Error converting address: " + addrString);
-            }
-            else
-            {
-                address = newAddress; // Set starting address
-                qDebug() << "Setting address to:" << address;
-            }
-            continue; // Skip further processing for ORG directive
+            error = ".BLKW takes a word count from 1 to 65536";
+            return false;
         }
-        else if (tokens[0].endsWith(','))
+        uint32_t size = static_cast<uint32_t>(value);
+        if (tokens.size() == 3)
         {
-            labels[tokens[0].chopped(1)] = address;
-            if (tokens.size() > 1)   ///////////////////////////////////
+            if (!parseDataWord(tokens[2].text, value))
             {
-                address++; // If there's an instruction on the same line, increment address
+                error = "Invalid .BLKW value: " + toQString(tokens[2].text);
+                return false;
             }
+            block.fill = static_cast<uint16_t>(value);
         }
-        else if (tokens[0] == "END")
+        block.size = size;
+        return true;
+    }
+    if (mnemonic == ".STRINGZ")
+    {
+        if (tokens.size() != 2 || tokens[1].kind != AsmTokenKind::String)
         {
-            break; // Stop processing at the end directive
+            error = ".STRINGZ takes one quoted string";
+            return false;
         }
-        else
+        for (char ch : tokens[1].text)
+            block.words.push_back(static_cast<uint8_t>(ch)); // One character per word, as the LC-3 console expects
+        block.words.push_back(0);
+        block.size = static_cast<uint32_t>(block.words.size());
+        return true;
+    }
+    if (mnemonic == ".INCBIN")
+    {
+        if (tokens.size() != 2)
         {
-            address++;
+            error = ".INCBIN takes one file name";
+            return false;
         }
+        AsmIncbinFiles *files = AsmIncbinScope::current();
+        AsmIncbinFiles unscoped; // Outside a build: relative to the working directory
+        if (!(files ? files : &unscoped)->load(toQString(tokens[1].text), block.words, error))
+            return false;
+        block.size = static_cast<uint32_t>(block.words.size());
+        return true;
     }
-    return labels;
+    error = "Invalid opcode: " + toQString(mnemonic);
+    return false;
 }
 
-// Main function to assemble instructions from lines and write to memory
-void assembleInstructionSetA(const QVector<QString> &lines, const QMap<QString, uint16_t> &labels, LC3Memory &memory)
+AsmIncbinFiles::AsmIncbinFiles(const QString &directory)
+    : directory(directory)
 {
-    uint16_t address = 0x3000; // Starting address
-
-    for (const QString &line : lines)
-    {
-        if (line.isEmpty() || line.startsWith(';'))
-            continue; // Ignore empty lines and comments
-
-        QRegularExpression re("\\s+");
-        QVector<QString> tokens = line.split(re, Qt::SkipEmptyParts);
+}
 
-        if (tokens.size() > 1 && tokens[0] == "ORG")
-        {
-            if (!parseOrgDirective(tokens, address))
-                continue;
-        }
-        else if (tokens.size() >= 1 && tokens[0] == "END")
-        {
-            break; // End of the program
-        }
-        else if (tokens[0].endsWith(','))
-        {
-            handleLabelledInstruction(line, address, labels, memory);
-        }
+bool AsmIncbinFiles::load(const QString &name, std::vector<uint16_t> &words, QString &error)
+{
+    QString path = directory.isEmpty() ? name : QDir(directory).filePath(name);
+    QMutexLocker lock(&mutex);
+    auto it = files.find(path);
+    if (it == files.end())
+    {
+        File loaded;
+        QFile file(path);
+        if (!file.open(QIODevice::ReadOnly))
+            loaded.error = "Cannot open " + path;
         else
         {
-            QVector<QString> tokens2 = splitLine(line, ' ');
-            if (validateInstructionFormat(tokens2, labels))
-            {
-                processInstruction(line, address, labels, memory);
-            }
+            fileReads++;
+            qint64 bytes = file.size();
+            if (bytes == 0 || bytes % 2 != 0 || bytes > qint64(LC3Memory::Size * sizeof(uint16_t)))
+                loaded.error = path + " is not a whole number of words between 1 and 65536";
             else
             {
-                QMessageBox::critical(nullptr, "Error", "Skipping invalid instruction: " + line);
+                loaded.words.resize(static_cast<std::size_t>(bytes / 2));
+                if (file.read(reinterpret_cast<char *>(loaded.words.data()), bytes) != bytes)
+                {
+                    loaded.error = "Cannot read " + path;
+                    loaded.words.clear();
+                }
+                else
+                    qFromLittleEndian<quint16>(loaded.words.data(), loaded.words.size(), loaded.words.data());
             }
         }
+        it = files.insert(path, std::move(loaded));
     }
-}
-
-// Function to convert an instruction line to binary
-QString assembleInstructionSetB(const QString &instruction, const QMap<QString, uint16_t> &labels, uint16_t currentAddress)
-{
-    QVector<QString> tokens = splitInstruction(instruction);
-    QString opcode = tokens[0];
-
-    if (opcode == "ADD") return assembleAdd(tokens);
-    if (opcode == "AND") return assembleAnd(tokens);
-    if (opcode.startsWith("BR")) return assembleBr(tokens, labels, currentAddress);
-    if (opcode == "JMP") return assembleJmp(tokens);
-    if (opcode == "JSR") return assembleJsr(tokens, labels, currentAddress);
-    if (opcode == "JSRR") return assembleJsrr(tokens);
-    if (opcode == "LD") return assembleLd(tokens, labels, currentAddress);
-    if (opcode == "LDI") return assembleLdi(tokens, labels, currentAddress);
-    if (opcode == "LDR") return assembleLdr(tokens);
-    if (opcode == "LEA") return assembleLea(tokens, labels, currentAddress);
-    if (opcode == "NOT") return assembleNot(tokens);
-    if (opcode == "RET") return assembleRet();
-    if (opcode == "ST") return assembleSt(tokens, labels, currentAddress);
-    if (opcode == "STI") return assembleSti(tokens, labels, currentAddress);
-    if (opcode == "STR") return assembleStr(tokens);
-    if (opcode == "HALT") return assembleHalt();
-    if (opcode == "DEC") return assembleDec(tokens);
-    if (opcode == "HEX") return assembleHex(tokens);
-
-    qWarning() << "Unknown opcode:" << opcode;
-    return "";
-}
-
-// Function to parse ORG directive and set the address
-bool parseOrgDirective(const QVector<QString> &tokens, uint16_t &address)
-{
-    QString addrString = tokens[1];
-    bool ok;
-    uint16_t newAddress = static_cast<uint16_t>(addrString.toInt(&ok, 16));
-    if (!ok)
+    if (!it->error.isEmpty())
     {
-        QMessageBox::critical(nullptr, "Error", "Error converting address: " + addrString);
+        error = it->error;
         return false;
     }
-    address = newAddress; // Set starting address
-    qDebug() << "Setting address to:" << address;
+    words = it->words;
     return true;
 }
 
-// Function to process an instruction line and write it to memory
-bool processInstruction(const QString &line, uint16_t &address, const QMap<QString, uint16_t> &labels, LC3Memory &memory)
+AsmIncbinScope::AsmIncbinScope(AsmIncbinFiles *files)
+    : previous(currentIncbinFiles)
 {
-    QString binaryInstruction = assembleInstructionSetB(line, labels, address);
-    bool ok;
-    uint16_t machineCode = static_cast<uint16_t>(binaryInstruction.toUInt(&ok, 2));
-    if (!ok)
-    {
-        QMessageBox::critical(nullptr, "Error", "Failed to convert binary instruction to machine code");
-        return false;
-    }
-    memory.write(address, machineCode); // Write machine code to memory
-    address++;                          // Increment address
-    return true;
+    currentIncbinFiles = files;
 }
 
-
-// Function to handle labelled instructions
-bool handleLabelledInstruction(const QString &line, uint16_t &address, const QMap<QString, uint16_t> &labels, LC3Memory &memory)
+AsmIncbinScope::~AsmIncbinScope()
 {
-    QString instruction = line.mid(line.indexOf(',') + 1).trimmed();
-    QVector<QString> tokens = splitLine(instruction, ' ');
-    if (validateInstructionFormat(tokens, labels))
-    {
-        return processInstruction(instruction, address, labels, memory);
-    }
-    else
-    {
-        QMessageBox::warning(nullptr, "Warning", "Skipping invalid instruction: " + line);
-        return false;
-    }
+    currentIncbinFiles = previous;
 }
 
-QVector<QString> splitInstruction(const QString &instruction)
+AsmIncbinFiles *AsmIncbinScope::current()
 {
-    QRegularExpression re("\\s+");
-    QVector<QString> tokens = instruction.split(re, Qt::SkipEmptyParts);
-    for (int i = 0; i < tokens.size(); ++i)
-    {
-        tokens[i] = tokens[i].remove(',').trimmed(); // Remove commas and trim tokens
-    }
-    return tokens;
+    return currentIncbinFiles;
 }
 
-
-QString assembleAdd(const QVector<QString> &tokens)
+void writeAsmBlock(const AsmBlock &block, uint16_t address, LC3Memory &memory)
 {
-    QString dr = intToBinaryString(tokens[1].mid(1).toInt(), 3);
-    QString sr1 = intToBinaryString(tokens[2].mid(1).toInt(), 3);
-    if (tokens[3].startsWith('R'))
-    {
-        QString sr2 = intToBinaryString(tokens[3].mid(1).toInt(), 3);
-        return "0001" + dr + sr1 + "000" + sr2;
-    }
+    if (block.words.empty())
+        memory.fill(address, block.size, block.fill);
     else
-    {
-        int imm5 = tokens[3].mid(1).toInt(); // Remove the '#' and convert to integer
-        return "0001" + dr + sr1 + "1" + intToBinaryString(imm5, 5);
-    }
+        memory.writeBlock(address, block.words);
 }
 
-QString assembleAnd(const QVector<QString> &tokens)
+int assemblyFileReads()
 {
-    QString dr = intToBinaryString(tokens[1].mid(1).toInt(), 3);  // Destination register
-    QString sr1 = intToBinaryString(tokens[2].mid(1).toInt(), 3); // Source register 1
+    return fileReads;
+}
 
-    if (tokens[3].startsWith('R'))
+// Expands a block directive and checks it fits at address, reporting any problem.
+// A block that does not fit is not written but still takes its size.
+static bool blockAt(const AsmLine &line, uint16_t address, AsmBlock &block)
+{
+    QString error;
+    if (!expandBlockDirective(line.statement, block, error))
     {
-        // Register-to-register AND operation
-        QString sr2 = intToBinaryString(tokens[3].mid(1).toInt(), 3); // Source register 2
-        return "0101" + dr + sr1 + "000" + sr2;
+        reportAssemblyError(line.number, QString("%1 on line %2: %3").arg(error).arg(line.number).arg(toQString(line.text)));
+        return false;
     }
-    else
+    if (!block.fitsAt(address))
     {
-        // Immediate AND operation
-        int imm5 = tokens[3].mid(1).toInt(); // Immediate value
-        return "0101" + dr + sr1 + "1" + intToBinaryString(imm5, 5);
+        reportAssemblyError(line.number, QString("Block on line %1 runs past xFFFF").arg(line.number));
+        return false;
     }
+    return true;
 }
 
-QString assembleBr(const QVector<QString> &tokens, const QMap<QString, uint16_t> &labels, uint16_t currentAddress)
-{
-    QString n = tokens[0].contains('n') ? "1" : "0"; // Check if 'n' condition flag is present
-    QString z = tokens[0].contains('z') ? "1" : "0"; // Check if 'z' condition flag is present
-    QString p = tokens[0].contains('p') ? "1" : "0"; // Check if 'p' condition flag is present
-
-    int offset = labels.value(tokens[1]) - currentAddress - 1;
-    QString offsetBinary = intToBinaryString(offset, 9); // This will handle both positive and negative offsets
-    return "0000" + n + z + p + offsetBinary;
-}
-
-QString assembleJmp(const QVector<QString> &tokens)
+//labels and their corresponding memory addresses
+AsmSymbolTable processLabels(std::string_view source)
 {
-    QString BaseR = tokens[1];
-    int BaseRNum = BaseR.mid(1).toInt(); // Remove 'R' and convert to int
+    AsmSymbolTable labels;
+    uint16_t address = 0x3000; // Starting address
+    AsmLexer lexer(source);
+    AsmLine line;
+    while (lexer.nextLine(line))
+    {
+        if (line.label)
+        {
+            labels.insert(line.label->text, address);
+        }
 
-    // Construct binary instruction
-    QString binaryInstruction = "1100000";
-    binaryInstruction += intToBinaryString(BaseRNum, 3);
-    binaryInstruction += "000000";
+        AsmTokens tokens = line.statement;
+        if (tokens.empty() || isLinkageDirective(tokens))
+            continue; // Label on a line of its own, or EXPORT/IMPORT
 
-    return binaryInstruction;
+        if (isDirective(tokens, Lc3EntryKind::Org))
+        {
+            parseOrgDirective(tokens, address);
+            continue; // Skip further processing for ORG directive
+        }
+        else if (isDirective(tokens, Lc3EntryKind::End))
+        {
+            break; // Stop processing at the end directive
+        }
+        else if (isDirective(tokens, Lc3EntryKind::Block))
+        {
+            AsmBlock block;
+            QString error;
+            if (expandBlockDirective(tokens, block, error))
+                address += block.size; // Errors are reported when the block is written
+        }
+        else
+        {
+            address++;
+        }
+    }
+    return labels;
 }
 
-QString assembleJsr(const QVector<QString> &tokens, const QMap<QString, uint16_t> &labels, uint16_t currentAddress)
+// Main function to assemble instructions from source text and write to memory.
+// Returns one past the highest address written.
+uint32_t assembleInstructionSetA(std::string_view source, const AsmSymbolTable &labels, LC3Memory &memory)
 {
-    QString label = tokens[1];
-    uint16_t subroutineAddress = labels.value(label);
-
-    // Calculate the offset from current address
-    int16_t offset = subroutineAddress - currentAddress - 1;
-
-    // Convert offset to binary with 11 bits
-    QString offsetBinary = intToBinaryString(offset, 11);
+    uint16_t address = 0x3000; // Starting address
+    uint32_t endAddress = address;
+    AsmLexer lexer(source);
+    AsmLine line;
 
-    // Construct the binary instruction
-    QString binaryInstruction = "0100";
-    binaryInstruction += "1";
-    binaryInstruction += offsetBinary;
+    while (lexer.nextLine(line))
+    {
+        AsmTokens tokens = line.statement;
+        if (tokens.empty() || isLinkageDirective(tokens))
+            continue; // Label on a line of its own, or EXPORT/IMPORT
 
-    return binaryInstruction;
+        if (isDirective(tokens, Lc3EntryKind::Org))
+        {
+            if (!parseOrgDirective(tokens, address))
+                continue;
+        }
+        else if (isDirective(tokens, Lc3EntryKind::End))
+        {
+            break; // End of the program
+        }
+        else if (isDirective(tokens, Lc3EntryKind::Block))
+        {
+            AsmBlock block;
+            if (blockAt(line, address, block))
+            {
+                writeAsmBlock(block, address, memory);
+                recordSourceLine(address, block.size, line.number);
+                endAddress = std::max<uint32_t>(endAddress, address + block.size);
+            }
+            address += block.size;
+        }
+        else if (validateInstructionFormat(tokens, labels))
+        {
+            uint16_t instructionAddress = address;
+            if (processInstruction(line, address, labels, memory))
+            {
+                recordSourceLine(instructionAddress, 1, line.number);
+                endAddress = std::max<uint32_t>(endAddress, instructionAddress + 1u);
+            }
+        }
+        else
+        {
+            reportAssemblyError(line.number, QString("Skipping invalid instruction on line %1: %2").arg(line.number).arg(toQString(line.text)));
+            address++; // The line keeps its slot, as processLabels gave it one
+        }
+    }
+    return endAddress;
 }
 
-QString assembleJsrr(const QVector<QString> &tokens)
+// Whether token could name a label that has not been defined yet
+static bool isForwardLabel(const AsmToken &token)
 {
-    QString BaseR = tokens[1];
-    int BaseRNum = BaseR.mid(1).toInt();
-
-    // Construct binary instruction
-    QString binaryInstruction = "0100000";
-    binaryInstruction += intToBinaryString(BaseRNum, 3);
-    binaryInstruction += "000000";
-
-    return binaryInstruction;
+    int value;
+    return token.kind == AsmTokenKind::Word && !asmParseRegister(token.text, value) && !asmParseImmediate(token.text, value);
 }
 
-QString assembleLd(const QVector<QString> &tokens, const QMap<QString, uint16_t> &labels, uint16_t currentAddress)
+// Whether token is acceptable for the operand field, ignoring PC offset range
+static bool operandValid(const Lc3OperandField &field, const AsmToken &token, const AsmSymbolTable &labels,
+                         bool allowForward)
 {
-    QString dr = intToBinaryString(tokens[1].mid(1).toInt(), 3);
-    int offset = labels.value(tokens[2]) - currentAddress - 1;
-    return "0010" + dr + intToBinaryString(offset, 9);
+    int value;
+    uint16_t packed;
+    switch (field.kind)
+    {
+    case Lc3OperandKind::Register:
+        return asmParseRegister(token.text, value);
+    case Lc3OperandKind::RegisterOrImmediate:
+        return asmParseRegister(token.text, value) ||
+               (asmParseImmediate(token.text, value) && lc3SignedField(value, field.width, packed));
+    case Lc3OperandKind::SignedImmediate:
+        return asmParseImmediate(token.text, value) && lc3SignedField(value, field.width, packed);
+    case Lc3OperandKind::PcOffset:
+        return hasLabel(labels, token) || (allowForward && isForwardLabel(token));
+    case Lc3OperandKind::DecimalWord:
+        return asmParseInteger(token.text, 10, value) && value >= -32768 && value <= 0xFFFF;
+    case Lc3OperandKind::HexWord:
+        return asmParseInteger(token.text, 16, value) && value >= -32768 && value <= 0xFFFF;
+    case Lc3OperandKind::UnsignedDecimal:
+        return asmParseInteger(token.text, 10, value) && value >= 0 && value < (1 << field.width);
+    case Lc3OperandKind::AnyWord:
+        return parseDataWord(token.text, value);
+    case Lc3OperandKind::Text:
+    case Lc3OperandKind::Symbol:
+    case Lc3OperandKind::None:
+        break;
+    }
+    return false;
 }
 
-QString assembleLdi(const QVector<QString> &tokens, const QMap<QString, uint16_t> &labels, uint16_t currentAddress)
+// ORs the operand into word; false if a PC offset does not reach its label.
+// With forward set, an undefined label leaves the field zero and queues a fixup instead.
+static bool encodeOperand(const Lc3OperandField &field, const AsmToken &token, const AsmSymbolTable &labels,
+                          uint16_t currentAddress, uint16_t &word, AsmFixups *forward, int line)
 {
-    QString dr = intToBinaryString(tokens[1].mid(1).toInt(), 3);
-    int offset = labels.value(tokens[2]) - currentAddress - 1;
-    return "1010" + dr + intToBinaryString(offset, 9);
+    int value = 0;
+    uint16_t packed = 0;
+    switch (field.kind)
+    {
+    case Lc3OperandKind::Register:
+        asmParseRegister(token.text, value);
+        word |= value << field.shift;
+        return true;
+    case Lc3OperandKind::RegisterOrImmediate:
+        if (asmParseRegister(token.text, value))
+        {
+            word |= value;
+            return true;
+        }
+        asmParseImmediate(token.text, value);
+        if (!lc3SignedField(value, field.width, packed))
+            return false;
+        word |= 1 << 5 | packed;
+        return true;
+    case Lc3OperandKind::SignedImmediate:
+        asmParseImmediate(token.text, value);
+        if (!lc3SignedField(value, field.width, packed))
+            return false;
+        word |= packed << field.shift;
+        return true;
+    case Lc3OperandKind::PcOffset:
+        if (forward && !hasLabel(labels, token))
+        {
+            (*forward)[toQString(token.text)].append(AsmFixup{currentAddress, field.width, line});
+            return true;
+        }
+        // Taken modulo 2^16 so code near xFFFF can reach x0000
+        value = static_cast<int16_t>(labelAddress(labels, token) - currentAddress - 1);
+        if (!lc3SignedField(value, field.width, packed))
+            return false;
+        word |= packed;
+        return true;
+    case Lc3OperandKind::DecimalWord:
+    case Lc3OperandKind::UnsignedDecimal:
+        asmParseInteger(token.text, 10, value);
+        word |= static_cast<uint16_t>(value);
+        return true;
+    case Lc3OperandKind::HexWord:
+        asmParseInteger(token.text, 16, value);
+        word |= static_cast<uint16_t>(value);
+        return true;
+    case Lc3OperandKind::AnyWord:
+        asmParseImmediate(token.text, value);
+        word |= static_cast<uint16_t>(value);
+        return true;
+    case Lc3OperandKind::Text:
+    case Lc3OperandKind::Symbol:
+    case Lc3OperandKind::None:
+        break;
+    }
+    return false;
 }
 
-QString assembleLdr(const QVector<QString> &tokens)
+static bool encodeStatement(AsmTokens tokens, const AsmSymbolTable &labels, uint16_t currentAddress, uint16_t &word,
+                            AsmFixups *forward, int line)
 {
-    QString dr = intToBinaryString(tokens[1].mid(1).toInt(), 3);
-    QString baser = intToBinaryString(tokens[2].mid(1).toInt(), 3);
-    int offset = tokens[3].mid(1).toInt();
-    return "0110" + dr + baser + intToBinaryString(offset, 6);
-}
+    const Lc3InstructionDesc *desc = lc3FindMnemonic(tokens[0].text);
+    if (!desc || tokens.size() != desc->operandCount + 1u)
+        return false; // Callers validate the statement first and report it themselves
 
-QString assembleLea(const QVector<QString> &tokens, const QMap<QString, uint16_t> &labels, uint16_t currentAddress)
-{
-    QString dr = intToBinaryString(tokens[1].mid(1).toInt(), 3);
-    int offset = labels.value(tokens[2]) - currentAddress - 1;
-    return "1110" + dr + intToBinaryString(offset, 9);
+    word = desc->bits;
+    for (std::size_t i = 0; i < desc->operandCount; ++i)
+    {
+        if (!encodeOperand(desc->operands[i], tokens[i + 1], labels, currentAddress, word, forward, line))
+            return false;
+    }
+    return true;
 }
 
-QString assembleNot(const QVector<QString> &tokens)
+// Function to encode one instruction into its machine word. Returns false when a
+// PC offset does not reach its label.
+bool assembleInstructionSetB(AsmTokens tokens, const AsmSymbolTable &labels, uint16_t currentAddress, uint16_t &word)
 {
-    QString dr = intToBinaryString(tokens[1].mid(1).toInt(), 3);
-    QString sr = intToBinaryString(tokens[2].mid(1).toInt(), 3);
-    return "1001" + dr + sr + "111111";
+    return encodeStatement(tokens, labels, currentAddress, word, nullptr, 0);
 }
 
-QString assembleRet()
+// Function to parse ORG directive and set the address
+bool parseOrgDirective(AsmTokens tokens, uint16_t &address)
 {
-    return "1100000111000000";
+    int newAddress = 0;
+    if (tokens.size() < 2 || !asmParseInteger(tokens[1].text, 16, newAddress) || newAddress < 0 || newAddress > 0xFFFF)
+    {
+        reportAssemblyError(tokens[0].line, "Error converting address: " + (tokens.size() < 2 ? QString() : toQString(tokens[1].text)));
+        return false;
+    }
+    address = static_cast<uint16_t>(newAddress); // Set starting address
+    return true;
 }
 
-QString assembleSt(const QVector<QString> &tokens, const QMap<QString, uint16_t> &labels, uint16_t currentAddress)
+// Function to process an instruction line and write it to memory. The address
+// moves on even when the line is rejected, so later labels still match the words.
+bool processInstruction(const AsmLine &line, uint16_t &address, const AsmSymbolTable &labels, LC3Memory &memory)
 {
-    QString sr = intToBinaryString(tokens[1].mid(1).toInt(), 3);
-    int offsetValue = labels.value(tokens[2]) - currentAddress - 1;
-    QString offset = intToBinaryString(offsetValue, 9);
-    return "0011" + sr + offset;
+    uint16_t machineCode;
+    if (!assembleInstructionSetB(line.statement, labels, address, machineCode))
+    {
+        reportAssemblyError(line.number, QString("Immediate or PC offset out of range on line %1: %2").arg(line.number).arg(toQString(line.text)));
+        address++;
+        return false;
+    }
+    memory.write(address, machineCode); // Write machine code to memory
+    address++;                          // Increment address
+    return true;
 }
 
-QString assembleSti(const QVector<QString> &tokens, const QMap<QString, uint16_t> &labels, uint16_t currentAddress)
+// Function to validate the instruction format against the instruction table
+bool validateInstructionFormat(AsmTokens tokens, const AsmSymbolTable &labels, bool allowForward)
 {
-    QString sr = intToBinaryString(tokens[1].mid(1).toInt(), 3);
-    QString offset = intToBinaryString(labels.value(tokens[2]) - currentAddress - 1, 9);
-    return "1011" + sr + offset;
-}
+    if (tokens.empty())
+        return false;
 
-QString assembleStr(const QVector<QString> &tokens)
-{
-    QString sr = intToBinaryString(tokens[1].mid(1).toInt(), 3);
-    QString baseR = intToBinaryString(tokens[2].mid(1).toInt(), 3);
-    int offset6 = tokens[3].mid(1).toInt();
-    return "0111" + sr + baseR + intToBinaryString(offset6, 6);
-}
+    const Lc3InstructionDesc *desc = lc3FindMnemonic(tokens[0].text);
+    if (!desc)
+    {
+        reportAssemblyError(tokens[0].line, "Invalid opcode: " + toQString(tokens[0].text));
+        return false;
+    }
+    if (tokens.size() != desc->operandCount + 1u)
+        return false;
 
-QString assembleHalt()
-{
-    return "1111000000100101"; // TRAP x25
+    for (std::size_t i = 0; i < desc->operandCount; ++i)
+    {
+        if (!operandValid(desc->operands[i], tokens[i + 1], labels, allowForward))
+            return false;
+    }
+    return true;
 }
 
-QString assembleDec(const QVector<QString> &tokens)
+// Validates and encodes one statement without a symbol table and without reporting,
+// for callers that resolve labels themselves. A PC offset field is left zero and its
+// label and width are returned in target/targetWidth (target stays empty when the
+// statement has none). On failure error says why the statement was rejected.
+bool assembleDeferred(AsmTokens tokens, uint16_t &word, QString &target, uint8_t &targetWidth, QString &error)
 {
-    bool ok;
-    int16_t value = tokens[1].toInt(&ok);
-    if (!ok)
+    static const AsmSymbolTable noLabels;
+
+    target.clear();
+    const Lc3InstructionDesc *desc = lc3FindMnemonic(tokens[0].text);
+    if (!desc)
+    {
+        error = "Invalid opcode: " + toQString(tokens[0].text);
+        return false;
+    }
+    if (tokens.size() != desc->operandCount + 1u)
+    {
+        error = QString("%1 takes %2 operand(s)").arg(toQString(tokens[0].text)).arg(desc->operandCount);
+        return false;
+    }
+    for (std::size_t i = 0; i < desc->operandCount; ++i)
+    {
+        if (!operandValid(desc->operands[i], tokens[i + 1], noLabels, true))
+        {
+            error = "Invalid operand: " + toQString(tokens[i + 1].text);
+            return false;
+        }
+    }
+
+    AsmFixups forward;
+    if (!encodeStatement(tokens, noLabels, 0, word, &forward, 0))
     {
-        qWarning() << "Invalid .DEC value:" << tokens[1];
-        return "";
+        error = "Immediate out of range";
+        return false;
+    }
+    auto it = forward.cbegin();
+    if (it != forward.cend())
+    {
+        target = it.key();
+        targetWidth = it.value().first().width;
     }
-    return intToBinaryString(value, 16);
+    return true;
 }
 
-QString assembleHex(const QVector<QString> &tokens)
+// Patches the offset field of each queued reference now that the label's address is known
+static void resolveFixups(const QString &label, uint16_t labelAddress, AsmFixups &pending, LC3Memory &memory)
 {
-    bool ok;
-    uint16_t value = tokens[1].toUInt(&ok, 16);
-    if (!ok)
+    for (const AsmFixup &fixup : pending.take(label))
     {
-        qWarning() << "Invalid .HEX value:" << tokens[1];
-        return "";
+        uint16_t packed;
+        int offset = static_cast<int16_t>(labelAddress - fixup.address - 1);
+        if (!lc3SignedField(offset, fixup.width, packed))
+        {
+            reportAssemblyError(fixup.line, QString("PC offset to %1 out of range on line %2").arg(label).arg(fixup.line));
+            continue;
+        }
+        memory.write(fixup.address, memory.read(fixup.address) | packed);
     }
-    return intToBinaryString(value, 16);
 }
 
-// Function to split a line into tokens
-QVector<QString> splitLine(const QString &line, const QChar &separator)
+// Assembles one chunk of source in a single pass, carrying address, fixups and END
+// across calls so a large file can be fed piece by piece. Backward references are
+// encoded directly; forward references are queued and patched when their label is
+// defined. Chunks must end on a line boundary. Returns false once END is reached.
+bool assembleChunk(std::string_view chunk, uint32_t firstLine, AsmSymbolTable &labels, LC3Memory &memory,
+                   AsmPassState &state)
 {
-    QVector<QString> tokens;
-    QString currentToken;
-    bool commentFound = false;
+    if (state.ended)
+        return false;
 
-    for (int i = 0; i < line.size(); ++i)
+    AsmLexer lexer(chunk, firstLine);
+    AsmLine line;
+    while (lexer.nextLine(line))
     {
-        QChar ch = line.at(i);
+        if (line.label)
+        {
+            std::string_view name = line.label->text;
+            if (labels.contains(name))
+                reportAssemblyError(line.number, QString("Label %1 redefined on line %2").arg(toQString(name)).arg(line.number));
+            labels.insert(name, state.address);
+            if (!state.pending.isEmpty() && state.pending.contains(toQString(name)))
+                resolveFixups(toQString(name), state.address, state.pending, memory);
+        }
+
+        AsmTokens tokens = line.statement;
+        if (tokens.empty() || isLinkageDirective(tokens))
+            continue; // Label on a line of its own, or EXPORT/IMPORT
 
-        if (ch == ';')
+        if (isDirective(tokens, Lc3EntryKind::Org))
+        {
+            parseOrgDirective(tokens, state.address);
+            continue;
+        }
+        if (isDirective(tokens, Lc3EntryKind::End))
         {
-            commentFound = true;
-            break;
+            state.ended = true; // End of the program
+            return false;
         }
-        else if (ch == separator)
+        if (isDirective(tokens, Lc3EntryKind::Block))
         {
-            if (!currentToken.isEmpty())
+            AsmBlock block;
+            if (blockAt(line, state.address, block))
             {
-                tokens.append(currentToken.trimmed());
-                currentToken.clear();
+                writeAsmBlock(block, state.address, memory);
+                recordSourceLine(state.address, block.size, line.number);
+                state.endAddress = std::max<uint32_t>(state.endAddress, state.address + block.size);
             }
+            state.address += block.size;
+            continue;
+        }
+
+        uint16_t machineCode;
+        if (!validateInstructionFormat(tokens, labels, true))
+        {
+            reportAssemblyError(line.number, QString("Skipping invalid instruction on line %1: %2").arg(line.number).arg(toQString(line.text)));
+        }
+        else if (!encodeStatement(tokens, labels, state.address, machineCode, &state.pending, line.number))
+        {
+            reportAssemblyError(line.number, QString("Immediate or PC offset out of range on line %1: %2").arg(line.number).arg(toQString(line.text)));
         }
         else
         {
-            currentToken += ch;
+            memory.write(state.address, machineCode);
+            recordSourceLine(state.address, 1, line.number);
+            state.endAddress = std::max<uint32_t>(state.endAddress, state.address + 1u);
         }
+        state.address++; // A rejected statement still takes its slot so later labels stay put
     }
-
-    if (!currentToken.isEmpty())
-    {
-        tokens.append(currentToken.trimmed());
-    }
-
-    return tokens;
+    return true;
 }
 
-// Function to validate the instruction format
-bool validateInstructionFormat(const QVector<QString> &tokens, const QMap<QString, uint16_t> &labels)
+// Reports every label still referenced but never defined. Returns one past the
+// highest address written.
+uint32_t finishSinglePass(AsmPassState &state)
 {
-    if (tokens.isEmpty())
-        return false;
-
-    QString opcode = tokens[0].trimmed();
-
-    auto isRegister = [](const QString &token)
-    {
-        return token.size() >= 2 && token.startsWith('R') && token.at(1).isDigit() && token.mid(1).toInt() >= 0 && token.mid(1).toInt() <= 7;
-    };
-
-    if ((opcode == "ADD" || opcode == "AND") && tokens.size() == 4)
+    for (auto it = state.pending.cbegin(); it != state.pending.cend(); ++it)
     {
-        return isRegister(tokens[1]) && isRegister(tokens[2]) &&
-               (tokens[3].startsWith('R') ? isRegister(tokens[3]) : tokens[3].mid(1).toInt() >= -16 && tokens[3].mid(1).toInt() <= 15);
-    }
-    else if (opcode.startsWith("BR") && tokens.size() == 2)
-    {
-        return labels.contains(tokens[1]);
-    }
-    else if ((opcode == "JMP" || opcode == "JSRR") && tokens.size() == 2)
-    {
-        return isRegister(tokens[1]);
-    }
-    else if (opcode == "JSR" && tokens.size() == 2)
-    {
-        return labels.contains(tokens[1]);
-    }
-    else if ((opcode == "LD" || opcode == "LDI" || opcode == "LEA" || opcode == "ST" || opcode == "STI") && tokens.size() == 3)
-    {
-        return isRegister(tokens[1]) && labels.contains(tokens[2]);
-    }
-    else if ((opcode == "LDR" || opcode == "STR") && tokens.size() == 4)
-    {
-        return isRegister(tokens[1]) && isRegister(tokens[2]) &&
-               tokens[3].toInt() >= -32 && tokens[3].toInt() <= 31;
-    }
-    else if (opcode == "NOT" && tokens.size() == 3)
-    {
-        return isRegister(tokens[1]) && isRegister(tokens[2]);
-    }
-    else if ((opcode == "RET" || opcode == "HALT" || opcode == "END") && tokens.size() == 1)
-    {
-        return true;
-    }
-    else if ((opcode == "WORD" || opcode == "BYTE") && tokens.size() == 2)
-    {
-        bool ok;
-        tokens[1].toUInt(&ok);
-        return ok;
-    }
-    else if (opcode == "DEC" && tokens.size() == 2)
-    {
-        bool ok;
-        tokens[1].toInt(&ok);
-        return ok;
-    }
-    else if (opcode == "HEX" && tokens.size() == 2)
-    {
-        bool ok;
-        tokens[1].toUInt(&ok, 16);
-        return ok;
-    }
-    else
-    {
-        QMessageBox::critical(nullptr, "Error", "Invalid opcode: " + opcode);
-        return false;
+        reportAssemblyError(it.value().first().line, QString("Undefined label %1 on line %2").arg(it.key()).arg(it.value().first().line));
     }
+    return state.endAddress;
 }
 
-
-QString intToBinaryString(int value, int bits)
+// Assembles in one pass over the source, so every line is lexed once and labels
+// always match the addresses actually emitted.
+// Returns one past the highest address written; labels receives the symbol table.
+uint32_t assembleSinglePass(std::string_view source, AsmSymbolTable &labels, LC3Memory &memory)
 {
-    if (value < 0)
-    {
-        value = (1 << bits) + value; // Calculate two's complement for negative values
-        return QString::fromStdString(std::bitset<16>(value).to_string()).right(bits).rightJustified(bits, '1');
-    }
-    else
-    {
-        return QString::fromStdString(std::bitset<16>(value).to_string()).right(bits).rightJustified(bits, '0');
-    }
+    AsmPassState state;
+    assembleChunk(source, 1, labels, memory, state);
+    return finishSinglePass(state);
 }
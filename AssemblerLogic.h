@@ -2,43 +2,115 @@
 #define ASSEMBLERLOGIC_H
 
 #include "lc3memory.h"
+#include "asmdiagnostics.h"
+#include "asmlexer.h"
+#include "asmsourcemap.h"
+#include "asmsymbols.h"
+#include "lc3isa.h"
 #include <QString>
 #include <QVector>
 #include <QMap>
+#include <QHash>
+#include <QMutex>
 #include <QFile>
-#include <QTextStream>
-#include <QDebug>
-#include <QMessageBox>
-#include <bitset>
-
-QVector<QString> readLinesFromFile(const QString &filename);
-QMap<QString, uint16_t> processLabels(const QVector<QString> &lines);
-void assembleInstructionSetA(const QVector<QString> &lines, const QMap<QString, uint16_t> &labels, LC3Memory &memory);
-QString assembleInstructionSetB(const QString &instruction, const QMap<QString, uint16_t> &labels, uint16_t currentAddress);
-QVector<QString> splitLine(const QString &line, const QChar &separator);
-bool validateInstructionFormat(const QVector<QString> &tokens, const QMap<QString, uint16_t> &labels);
-QString intToBinaryString(int value, int bits);
-QVector<QString> splitInstruction(const QString &instruction);
-bool parseOrgDirective(const QVector<QString> &tokens, uint16_t &address);
-bool processInstruction(const QString &line, uint16_t &address, const QMap<QString, uint16_t> &labels, LC3Memory &memory);
-bool handleLabelledInstruction(const QString &line, uint16_t &address, const QMap<QString, uint16_t> &labels, LC3Memory &memory);
-void assembleInstructionSetA(const QVector<QString> &lines, const QMap<QString, uint16_t> &labels, LC3Memory &memory);
-QString assembleAdd(const QVector<QString> &tokens);
-QString assembleAnd(const QVector<QString> &tokens);
-QString assembleBr(const QVector<QString> &tokens, const QMap<QString, uint16_t> &labels, uint16_t currentAddress);
-QString assembleJmp(const QVector<QString> &tokens);
-QString assembleJsr(const QVector<QString> &tokens, const QMap<QString, uint16_t> &labels, uint16_t currentAddress);
-QString assembleJsrr(const QVector<QString> &tokens);
-QString assembleLd(const QVector<QString> &tokens, const QMap<QString, uint16_t> &labels, uint16_t currentAddress);
-QString assembleLdi(const QVector<QString> &tokens, const QMap<QString, uint16_t> &labels, uint16_t currentAddress);
-QString assembleLdr(const QVector<QString> &tokens);
-QString assembleLea(const QVector<QString> &tokens, const QMap<QString, uint16_t> &labels, uint16_t currentAddress);
-QString assembleNot(const QVector<QString> &tokens);
-QString assembleRet();
-QString assembleSt(const QVector<QString> &tokens, const QMap<QString, uint16_t> &labels, uint16_t currentAddress);
-QString assembleSti(const QVector<QString> &tokens, const QMap<QString, uint16_t> &labels, uint16_t currentAddress);
-QString assembleStr(const QVector<QString> &tokens);
-QString assembleHalt();
-QString assembleDec(const QVector<QString> &tokens);
-QString assembleHex(const QVector<QString> &tokens);
+#include <span>
+#include <string_view>
+#include <vector>
+
+// Bump whenever the same source would assemble to different words; cached images
+// built by an older assembler are then ignored
+constexpr uint32_t AssemblerVersion = 1;
+
+// A statement as produced by the lexer: the mnemonic followed by its operands
+using AsmTokens = std::span<const AsmToken>;
+
+// A PC offset field whose label was not yet defined when the instruction was emitted
+struct AsmFixup
+{
+    uint16_t address; // Word to patch
+    uint8_t width;    // Width of the offset field in bits
+    int line;         // Source line, for error messages
+};
+
+using AsmFixups = QMap<QString, QVector<AsmFixup>>;
+
+// What the single-pass assembler carries from one chunk of source to the next
+struct AsmPassState
+{
+    uint16_t address = 0x3000;
+    uint32_t endAddress = 0x3000; // One past the highest address written
+    AsmFixups pending;            // Forward references keyed by label
+    bool ended = false;           // END seen
+};
+
+// The words of a block directive. .BLKW keeps only a count and a fill value, so a
+// large reservation never builds a buffer.
+struct AsmBlock
+{
+    uint32_t size = 0;           // Words the directive takes
+    uint16_t fill = 0;           // .BLKW: the value of every word
+    std::vector<uint16_t> words; // .STRINGZ, .INCBIN: the words themselves
+
+    bool fitsAt(uint16_t address) const { return address + size <= LC3Memory::Size; }
+};
+
+// The files .INCBIN reads during one build. Names are resolved against the
+// directory of the source (the working directory if it is empty), and each file
+// is read from disk once however many passes and sections expand it.
+class AsmIncbinFiles
+{
+public:
+    explicit AsmIncbinFiles(const QString &directory = QString());
+
+    // The file's words, or false with error set
+    bool load(const QString &name, std::vector<uint16_t> &words, QString &error);
+
+private:
+    struct File
+    {
+        std::vector<uint16_t> words;
+        QString error; // Empty if the file was read
+    };
+
+    QString directory;
+    QMutex mutex; // Sections of one build expand their blocks on pool threads
+    QHash<QString, File> files;
+};
+
+// Makes files the set .INCBIN reads through on this thread until destroyed, the
+// way AsmDiagnosticCollector installs a sink. A build installs one around its
+// passes, and each pool thread that assembles a section for it installs the
+// same set; null leaves .INCBIN relative to the working directory.
+class AsmIncbinScope
+{
+public:
+    explicit AsmIncbinScope(AsmIncbinFiles *files);
+    ~AsmIncbinScope();
+    AsmIncbinScope(const AsmIncbinScope &) = delete;
+    AsmIncbinScope &operator=(const AsmIncbinScope &) = delete;
+
+    static AsmIncbinFiles *current();
+
+private:
+    AsmIncbinFiles *previous;
+};
+
+// Expands .BLKW n [value], .STRINGZ "text" or .INCBIN "file" (raw little-endian
+// words, no header, read through the current AsmIncbinScope). False with error
+// set if the directive is malformed; a rejected block takes no words.
+bool expandBlockDirective(AsmTokens tokens, AsmBlock &block, QString &error);
+void writeAsmBlock(const AsmBlock &block, uint16_t address, LC3Memory &memory); // One bulk write
+int assemblyFileReads(); // Files read from disk by .INCBIN so far; such builds depend on more than their source
+
+AsmSymbolTable processLabels(std::string_view source);
+uint32_t assembleInstructionSetA(std::string_view source, const AsmSymbolTable &labels, LC3Memory &memory);
+uint32_t assembleSinglePass(std::string_view source, AsmSymbolTable &labels, LC3Memory &memory);
+bool assembleChunk(std::string_view chunk, uint32_t firstLine, AsmSymbolTable &labels, LC3Memory &memory,
+                   AsmPassState &state);
+uint32_t finishSinglePass(AsmPassState &state);
+bool assembleInstructionSetB(AsmTokens tokens, const AsmSymbolTable &labels, uint16_t currentAddress, uint16_t &word);
+bool assembleDeferred(AsmTokens tokens, uint16_t &word, QString &target, uint8_t &targetWidth, QString &error);
+bool validateInstructionFormat(AsmTokens tokens, const AsmSymbolTable &labels, bool allowForward = false);
+bool parseOrgDirective(AsmTokens tokens, uint16_t &address);
+bool processInstruction(const AsmLine &line, uint16_t &address, const AsmSymbolTable &labels, LC3Memory &memory);
 #endif // ASSEMBLERLOGIC_H
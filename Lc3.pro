@@ -1,31 +1,25 @@
-QT       += core gui
+QT       += core gui concurrent
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
-CONFIG += c++17
+CONFIG += c++20
 
 # You can make your code fail to compile if it uses deprecated APIs.
 # In order to do so, uncomment the following line.
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
+include(lc3core.pri)
+
 SOURCES += \
-    AssemblerLogic.cpp \
-    FileReadWrite.cpp \
     Logic.cpp \
     assembler.cpp \
-    lc3instructions.cpp \
-    lc3memory.cpp \
-    lc3registers.cpp \
-    mainWindow.cpp
+    mainWindow.cpp \
+    memorytablemodel.cpp
 
 HEADERS += \
-    AssemblerLogic.h \
-    FileReadWrite.h \
     Logic.h \
     assembler.h \
-    lc3instructions.h \
-    lc3memory.h \
-    lc3registers.h
+    memorytablemodel.h
 
 FORMS += \
     Logic.ui
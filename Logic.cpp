@@ -2,21 +2,45 @@
 #include "Logic.h"
 #include "lc3instructions.h"
 #include "ui_Logic.h"
+#include <QDir>
 #include <QFileDialog>
+#include <QFileInfo>
 #include <QVBoxLayout>
 #include <QLabel>
 #include <QMessageBox>
 #include <QTableWidget>
 #include <QTableWidgetItem>
+#include <QTextStream>
 #include <QScrollBar>
-LC3Memory memory(0xFFFF);
+#include <QTextBlock>
+#include <QTextCursor>
+#include <QTextDocument>
+#include <QStandardPaths>
+#include <QtConcurrent/QtConcurrentRun>
+#include <QRegularExpression>
+#include <algorithm>
+#include <vector>
+LC3Memory memory;
 LC3Registers registers;
-LC3Instructions instructions;
+LC3Instructions instructions(registers, memory);
 QString fileName;
+QStringList moduleFiles; // Set when several modules are uploaded to be linked together
 int index;
 int sc=1;
+
+// Uploaded sources above this size are assembled from disk instead of being loaded into the editor
+static constexpr qint64 MaxEditorSourceSize = 4 * 1024 * 1024;
+
+// Quiet time after the last keystroke before the editor is re-assembled
+static constexpr int ReassembleDelayMs = 300;
+
+static QString checkpointDirectory()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/checkpoints";
+}
+
 Logic::Logic(QWidget *parent)
-    : QMainWindow(parent), ui(new Ui::lc3)
+    : QMainWindow(parent), ui(new Ui::lc3), checkpointer(checkpointDirectory())
 {
     ui->setupUi(this);
     setFixedSize(1260, 610);
@@ -25,10 +49,27 @@ Logic::Logic(QWidget *parent)
     setupRegisterTable();
     setupAdditionalTable();
     setupFlagsTable();
+    memory.addObserver(this);
+
+    reassembleTimer.setSingleShot(true);
+    reassembleTimer.setInterval(ReassembleDelayMs);
+    connect(ui->textEdit, &QTextEdit::textChanged, this, [this]() {
+        ++editGeneration;
+        reassembleTimer.start();
+        ui->textEdit->setExtraSelections({}); // The source map is for the text as assembled
+    });
+    connect(&reassembleTimer, &QTimer::timeout, this, &Logic::startBackgroundAssembly);
+    connect(&reassembleWatcher, &QFutureWatcher<void>::finished, this, [this]() {
+        assembledGeneration = runningGeneration;
+        if (assembledGeneration != editGeneration && !reassembleTimer.isActive())
+            startBackgroundAssembly(); // Edited while the update was running
+    });
 }
 
 Logic::~Logic()
 {
+    reassembleWatcher.waitForFinished();
+    memory.removeObserver(this);
     delete ui;
 }
 
@@ -238,38 +279,40 @@ void Logic::updateRegisters()
 
 }
 
-void Logic::updateMemory(int scrollToIndex)
+// Repaint only the rows of the pages written since the last update
+void Logic::memoryChanged(std::span<const LC3MemoryRange> ranges)
 {
-    int rowCount = ui->memoryTable->rowCount();
+    lastFindText.clear(); // Search results are stale
+    memoryModel->wordsChanged(ranges);
+}
 
-    for (int index = 0; index < rowCount; ++index)
-    {
-        QTableWidgetItem *valueItem = new QTableWidgetItem(QString("0x%1").arg(memory.read(index), 4, 16, QChar('0')).toUpper());
-        valueItem->setTextAlignment(Qt::AlignCenter); // Align text to center
-        ui->memoryTable->setItem(index, 1, valueItem);
-    }
+void Logic::updateMemory(int scrollToIndex)
+{
+    memory.publishChanges();
 
     // Ensure scrollToIndex is within bounds
-    if (scrollToIndex >= 0 && scrollToIndex < rowCount)
+    if (scrollToIndex >= 0 && scrollToIndex < memoryModel->rowCount())
     {
-        // Get the item at scrollToIndex
-        QTableWidgetItem *itemToScrollTo = ui->memoryTable->item(scrollToIndex, 1);
-
-        // Scroll to the item
-        if (itemToScrollTo)
-        {
-            ui->memoryTable->scrollToItem(itemToScrollTo, QAbstractItemView::PositionAtCenter);
-        }
+        ui->memoryTable->scrollTo(memoryModel->index(scrollToIndex, MemoryTableModel::ValueColumn), QAbstractItemView::PositionAtCenter);
     }
 }
 
 void Logic::memoryFill() {
-    // Set up table dimensions and headers
-    ui->memoryTable->setRowCount(0xFFFF); // Set row count to 0xFFFF (65535)
-    ui->memoryTable->setColumnCount(2);   // Two columns: Address and Value
-    QStringList headers = {"Address", "Value"};
-    ui->memoryTable->setHorizontalHeaderLabels(headers);
+    // The model reads each visible cell from memory when it is drawn, so the view
+    // is in sync with every page without copying any of them
+    memoryModel = new MemoryTableModel(memory, this);
+    ui->memoryTable->setModel(memoryModel);
+    memory.clearDirty();
+
     ui->memoryTable->verticalHeader()->setVisible(false); // Hide the vertical header
+    // Fixed row heights and column widths let the view place any of the 65,536 rows
+    // without measuring them; sizing to contents would disassemble every row
+    ui->memoryTable->verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
+    ui->memoryTable->horizontalHeader()->setSectionResizeMode(QHeaderView::Interactive);
+    ui->memoryTable->setColumnWidth(MemoryTableModel::AddressColumn, 80);
+    ui->memoryTable->setColumnWidth(MemoryTableModel::LabelColumn, 90);
+    ui->memoryTable->setColumnWidth(MemoryTableModel::ValueColumn, 80);
+    ui->memoryTable->setColumnWidth(MemoryTableModel::DisassemblyColumn, 170);
 
     // Set up header style with a complementary color
     QString headerStyle = "font: 700 11pt \"UD Digi Kyokasho NK-B\";"
@@ -280,17 +323,6 @@ void Logic::memoryFill() {
     // Apply style to header
     ui->memoryTable->horizontalHeader()->setStyleSheet("QHeaderView::section { " + headerStyle + " }");
 
-    // Populate table with memory values
-    for (size_t i = 0; i < 0xFFFF; ++i) {
-        QTableWidgetItem *addressItem = new QTableWidgetItem(QString("0x%1").arg(i, 4, 16, QChar('0')).toUpper());
-        addressItem->setTextAlignment(Qt::AlignCenter);
-        ui->memoryTable->setItem(i, 0, addressItem);
-
-        QTableWidgetItem *valueItem = new QTableWidgetItem(QString("0x%1").arg(memory.read(i), 4, 16, QChar('0')).toUpper());
-        valueItem->setTextAlignment(Qt::AlignCenter);
-        ui->memoryTable->setItem(i, 1, valueItem);
-    }
-
     // Make entire table non-editable and non-selectable
     ui->memoryTable->setEditTriggers(QAbstractItemView::NoEditTriggers);
     ui->memoryTable->setSelectionMode(QAbstractItemView::NoSelection);
@@ -302,17 +334,45 @@ void Logic::memoryFill() {
 
 void Logic::on_Upload_code_clicked()
 {
-    QString newFileName = QFileDialog::getOpenFileName(this, tr("Open File"), "", tr("Assembly Files (*.asm)"));
+    QStringList newFileNames = QFileDialog::getOpenFileNames(this, tr("Open File"), "", tr("Assembly Files (*.asm)"));
+    if (newFileNames.size() > 1)
+    {
+        // Several modules: Assemble builds each one (or reuses its cached object) and links them
+        for (const QString &name : std::as_const(newFileNames))
+        {
+            if (!name.endsWith(".asm", Qt::CaseInsensitive))
+            {
+                QMessageBox::warning(this, tr("Invalid File"), tr("Please select files with an .asm extension."));
+                return;
+            }
+        }
+        moduleFiles = newFileNames;
+        fileName.clear();
+        ui->textEdit->clear();
+        QMessageBox::information(this, tr("Modules Selected"), tr("You selected %1 modules. They will be linked in this order:\n%2").arg(newFileNames.size()).arg(newFileNames.join("\n")));
+        return;
+    }
+
+    QString newFileName = newFileNames.value(0);
+    moduleFiles.clear();
     if (!newFileName.isEmpty())
     {
         if (newFileName.endsWith(".asm", Qt::CaseInsensitive))
         {
             QFile file(newFileName);
-            if (file.open(QIODevice::ReadOnly | QIODevice::Text))
+            if (file.size() > MaxEditorSourceSize)
+            {
+                // Too big for the editor; Assemble reads it straight from disk
+                fileName = newFileName;
+                ui->textEdit->clear();
+                QMessageBox::information(this, tr("File Selected"), tr("You selected:\n%1\n\nThe file is too large to show in the editor and will be assembled directly from disk.").arg(newFileName));
+            }
+            else if (file.open(QIODevice::ReadOnly | QIODevice::Text))
             {
                 QTextStream in(&file);
                 ui->textEdit->setPlainText(in.readAll()); // Load file contents into text edit
                 file.close();
+                fileName = newFileName;
                 QMessageBox::information(this, tr("File Selected"), tr("You selected:\n%1").arg(newFileName));
             }
             else
@@ -332,54 +392,138 @@ void Logic::on_Upload_code_clicked()
 }
 
 void Logic::on_ASSEMBLE_clicked() {
-    QString code;
-
-    if (!ui->textEdit->toPlainText().isEmpty()) {
-        // Use text from QTextEdit if it's not empty (user entered code directly)
-        code = ui->textEdit->toPlainText();
-    } else if (!fileName.isEmpty()) {
-        // Load file contents if a file was previously uploaded
-        QFile file(fileName);
-        if (file.open(QIODevice::ReadOnly | QIODevice::Text)) {
-            QTextStream in(&file);
-            code = in.readAll();
-            file.close();
+    int result;
+
+    if (!ui->textEdit->document()->isEmpty()) {
+        // Use text from QTextEdit if it's not empty (user entered code directly).
+        // The background image is normally already current; a full assembly is only
+        // needed to report errors.
+        // .INCLUDE paths are relative to the uploaded file, if the text came from one
+        QString directory = fileName.isEmpty() ? QString() : QFileInfo(fileName).absolutePath();
+        if (ui->optimizeCheck->isChecked()) {
+            result = startAssembly(ui->textEdit->toPlainText(), true, directory); // The background image is not optimized
+        } else if (incrementalImageReady()) {
+            AsmSymbolTable labels;
+            AsmSourceMap sourceMap;
+            incremental.labels(labels);
+            incremental.sourceMap(sourceMap);
+            result = writeAssembly(incremental.image(), labels, sourceMap);
         } else {
-            QMessageBox::warning(this, tr("Error"), tr("Failed to open file for reading."));
-            return; // Exit if file cannot be opened
+            result = startAssembly(ui->textEdit->toPlainText(), false, directory);
         }
+    } else if (!moduleFiles.isEmpty()) {
+        result = startAssemblyModules(moduleFiles);
+    } else if (!fileName.isEmpty()) {
+        // Assemble the uploaded file from disk without copying it into a QString
+        result = startAssemblyFile(fileName);
     } else {
         QMessageBox::warning(this, tr("No Code Provided"), tr("Please either upload an .asm file or enter code in the text editor."));
         return; // Exit if no file or text is provided
     }
 
-    // Proceed with assembly using 'code'
-    int result = startAssembly(code); // Ensure 'code' is a QString
     if (result != 0) {
         qWarning() << "Assembly failed with error code:" << result;
         // Handle error scenario as needed
-    } else {
-        BinFile.readFromFile(0x3000);
-        registers.setPC(0x3000);
-        index = 0x3000;
-        memoryFill();
-        updateMemory(index); // Ensure memory is filled and visible
+        return;
+    }
+
+    // Every segment goes back to its own origin, so multi-ORG programs load whole
+    LC3ProgramFile program(ProgramFileName);
+    if (!program.open()) {
+        QMessageBox::critical(this, tr("Error"), program.errorString());
+        return;
+    }
+    program.load(memory);
+    AsmSymbolTable labels;
+    if (!program.readSymbols(labels))
+        labels.clear(); // No symbol section, or an unreadable one
+    memoryModel->setLabels(labels);
+    registers.setPC(program.entry());
+    index = program.entry();
+    updateMemory(index); // Ensure memory is filled and visible
+    highlightSourceLine(registers.getPC());
+    showCacheStats();
+}
+
+// Session totals, so a slow build can be told apart from a cache miss
+void Logic::showCacheStats()
+{
+    AssemblyCacheStats stats = assemblyCacheStats();
+    QStringList parts;
+    parts << tr("Image cache: %1 hits, %2 misses").arg(stats.imageHits).arg(stats.imageMisses);
+    if (stats.objectHits + stats.objectMisses > 0)
+        parts << tr("Object cache: %1 hits, %2 misses").arg(stats.objectHits).arg(stats.objectMisses);
+    if (stats.includeHits + stats.includeMisses > 0)
+        parts << tr("Include cache: %1 hits, %2 misses").arg(stats.includeHits).arg(stats.includeMisses);
+    ui->statusbar->showMessage(parts.join("  |  "));
+}
+
+void Logic::startBackgroundAssembly()
+{
+    if (reassembleWatcher.isRunning())
+        return; // The finished handler starts the next one
+
+    QByteArray source = ui->textEdit->toPlainText().toUtf8();
+    runningGeneration = editGeneration;
+    reassembleWatcher.setFuture(QtConcurrent::run([this, source]() {
+        incremental.update(std::string_view(source.constData(), source.size()));
+    }));
+}
+
+// Brings the incremental image up to the current editor text, finishing the update
+// in progress or running one here if an edit has not been picked up yet. True when
+// the image matches what a full assembly would produce.
+bool Logic::incrementalImageReady()
+{
+    reassembleWatcher.waitForFinished();
+    assembledGeneration = runningGeneration; // finished() may not have been delivered yet
+
+    if (assembledGeneration != editGeneration) {
+        reassembleTimer.stop();
+        QByteArray source = ui->textEdit->toPlainText().toUtf8();
+        incremental.update(std::string_view(source.constData(), source.size()));
+        assembledGeneration = runningGeneration = editGeneration;
+    }
+    return incremental.isClean();
+}
+
+// Marks the editor line that assembled to address, found through the source map
+// rather than by searching the text
+void Logic::highlightSourceLine(uint16_t address)
+{
+    QList<QTextEdit::ExtraSelection> selections;
+    QString file;
+    uint32_t line = 0;
+    if (assembledSourceMap.lookup(address, file, line) && file.isEmpty())
+    {
+        QTextBlock block = ui->textEdit->document()->findBlockByNumber(static_cast<int>(line) - 1);
+        if (block.isValid())
+        {
+            QTextEdit::ExtraSelection selection;
+            selection.format.setBackground(QColor(255, 236, 140));
+            selection.format.setProperty(QTextFormat::FullWidthSelection, true);
+            selection.cursor = QTextCursor(block);
+            selections.append(selection);
+            ui->textEdit->setTextCursor(selection.cursor); // Scrolls the line into view
+        }
     }
+    ui->textEdit->setExtraSelections(selections);
 }
 
 void Logic::on_Reset_clicked()
 {
     // Clear the file name variable
     fileName.clear();
+    moduleFiles.clear();
 
     // Clear the QTextEdit content
     ui->textEdit->clear();
 
     // Reset memory
+    memory.clear();
+    assembledSourceMap.clear();
+    memoryModel->setLabels(AsmSymbolTable());
 
-    for (uint16_t i = 0; i < 0xFFFF; ++i) {
-        memory.write(i, 0x0000);
-    }
     // Reset program counter (PC)
     registers.setPC(0x0000);
 
@@ -393,12 +537,7 @@ void Logic::on_Reset_clicked()
     updateAllFlags();
 
     // Clear memory table contents
-    for (int i = 0; i < ui->memoryTable->rowCount(); ++i) {
-        QTableWidgetItem *addressItem = ui->memoryTable->item(i, 0);
-        QTableWidgetItem *valueItem = ui->memoryTable->item(i, 1);
-        if (addressItem) addressItem->setText(QString("0x%1").arg(i, 4, 16, QChar('0')).toUpper());
-        if (valueItem) valueItem->setText("0x0000");
-    }
+    memory.publishChanges();
     ui->Phase->clear();
     // Reset simulation phase counter
     sc = 1;
@@ -416,7 +555,8 @@ void Logic::on_nextCycle_clicked()
     }
     else if (sc == 1)
     {
-        instructions.fetch(memory);
+        highlightSourceLine(registers.getPC()); // The instruction about to be fetched
+        instructions.fetch();
         if (instructions.isHalt())
         {
             QMessageBox::information(this, "Program Done", "The program has reached the HALT instruction and is done.");
@@ -438,14 +578,14 @@ void Logic::on_nextCycle_clicked()
     }
     else if (sc == 3)
     {
-        instructions.evaluateAddress(memory);
+        instructions.evaluateAddress();
         updateRegisters();
         ui->Phase->setText("Evaluate Address");
         sc++;
     }
     else if (sc == 4)
     {
-        instructions.fetchOperands(memory);
+        instructions.fetchOperands();
         updateRegisters();
         ui->Phase->setText("Fetch Operands");
         sc++;
@@ -458,7 +598,7 @@ void Logic::on_nextCycle_clicked()
     }
     else if (sc == 6)
     {
-        instructions.store(memory);
+        instructions.store();
         updateRegisters();
         ui->Phase->setText("Store");
         updateMemory(index);
@@ -494,3 +634,157 @@ END
     ui->textEdit->setText(sampleCode);
 }
 
+// Accepts a quoted string (one character per word) or a list of words separated by
+// spaces or commas: hex as x3000 / 0x3000, decimal as #-3 or -3.
+bool Logic::parseSearchPattern(const QString &text, std::vector<uint16_t> &pattern)
+{
+    QString trimmed = text.trimmed();
+    pattern.clear();
+
+    if (trimmed.size() >= 2 && trimmed.startsWith('"') && trimmed.endsWith('"'))
+    {
+        for (QChar ch : trimmed.mid(1, trimmed.size() - 2))
+        {
+            pattern.push_back(ch.unicode());
+        }
+        return !pattern.empty();
+    }
+
+    const QStringList tokens = trimmed.split(QRegularExpression("[\\s,]+"), Qt::SkipEmptyParts);
+    for (const QString &token : tokens)
+    {
+        bool ok;
+        int value;
+        if (token.startsWith("0x", Qt::CaseInsensitive))
+            value = token.mid(2).toInt(&ok, 16);
+        else if (token.startsWith('x', Qt::CaseInsensitive))
+            value = token.mid(1).toInt(&ok, 16);
+        else if (token.startsWith('#'))
+            value = token.mid(1).toInt(&ok, 10);
+        else
+            value = token.toInt(&ok, 10);
+
+        if (!ok || value < -32768 || value > 0xFFFF)
+            return false;
+        pattern.push_back(static_cast<uint16_t>(value));
+    }
+    return !pattern.empty();
+}
+
+void Logic::on_memoryFind_clicked()
+{
+    QString text = ui->memoryFindEdit->text();
+
+    if (text != lastFindText)
+    {
+        std::vector<uint16_t> pattern;
+        if (!parseSearchPattern(text, pattern))
+        {
+            QMessageBox::warning(this, tr("Find"), tr("Enter words such as x3000 x0025 or #-3, or a quoted \"string\"."));
+            return;
+        }
+        findHits = findPattern(memory, pattern);
+        findCursor = 0;
+        lastFindText = text;
+    }
+    else if (!findHits.empty())
+    {
+        findCursor = (findCursor + 1) % findHits.size();
+    }
+
+    if (findHits.empty())
+    {
+        ui->statusbar->showMessage(tr("No match for %1").arg(text));
+        return;
+    }
+
+    uint16_t address = findHits[findCursor];
+    QModelIndex hit = memoryModel->index(address, MemoryTableModel::ValueColumn);
+    ui->memoryTable->scrollTo(hit, QAbstractItemView::PositionAtCenter);
+    ui->memoryTable->setCurrentIndex(hit);
+    ui->statusbar->showMessage(tr("Match %1 of %2 at x%3 (%4)")
+                                   .arg(findCursor + 1)
+                                   .arg(findHits.size())
+                                   .arg(address, 4, 16, QChar('0'))
+                                   .arg(QString::fromLatin1(memorySearchIsa())));
+}
+
+void Logic::on_memorySnapshot_clicked()
+{
+    highlightedRanges.clear();
+    memoryModel->setHighlightedRanges(highlightedRanges);
+
+    memorySnapshot = LC3MemoryImage::capture(memory);
+    hasSnapshot = true;
+    ui->statusbar->showMessage(tr("Memory snapshot taken"));
+}
+
+void Logic::on_memoryDiff_clicked()
+{
+    if (!hasSnapshot)
+    {
+        QMessageBox::information(this, tr("Diff"), tr("Click 'Snapshot' first to remember the memory to compare against."));
+        return;
+    }
+
+    highlightedRanges = diffMemory(memory, memorySnapshot);
+    memoryModel->setHighlightedRanges(highlightedRanges);
+
+    if (highlightedRanges.empty())
+    {
+        ui->statusbar->showMessage(tr("No differences from the snapshot"));
+        return;
+    }
+
+    uint32_t words = 0;
+    for (const LC3MemoryRange &range : highlightedRanges)
+    {
+        words += range.length;
+    }
+    ui->memoryTable->scrollTo(memoryModel->index(highlightedRanges.front().start, MemoryTableModel::ValueColumn), QAbstractItemView::PositionAtCenter);
+    ui->statusbar->showMessage(tr("%1 words differ from the snapshot in %2 ranges").arg(words).arg(highlightedRanges.size()));
+}
+
+void Logic::on_saveState_clicked()
+{
+    if (sc != 1)
+    {
+        // A checkpoint holds no phase, so it is taken between instructions
+        QMessageBox::information(this, tr("Save State"), tr("Finish the current instruction with 'Next Phase' first."));
+        return;
+    }
+
+    auto *watcher = new QFutureWatcher<bool>(this);
+    connect(watcher, &QFutureWatcher<bool>::finished, this, [this, watcher]() {
+        if (!watcher->result())
+            QMessageBox::critical(this, tr("Error"), checkpointer.errorString());
+        watcher->deleteLater();
+    });
+    watcher->setFuture(checkpointer.checkpoint(registers, memory));
+    ui->statusbar->showMessage(tr("Saving machine state to %1").arg(QDir::toNativeSeparators(checkpointer.latest())));
+}
+
+void Logic::on_loadState_clicked()
+{
+    QString path = QFileDialog::getOpenFileName(this, tr("Load State"), checkpointDirectory(), tr("LC3 checkpoints (*.lc3ckpt)"));
+    if (path.isEmpty())
+        return;
+
+    checkpointer.waitForFinished(); // The file picked may still be being written
+    QString error;
+    if (!LC3Checkpointer::restore(path, registers, memory, error))
+    {
+        QMessageBox::critical(this, tr("Error"), error);
+        return;
+    }
+
+    sc = 1; // Resume at the fetch of the instruction at PC
+    ui->Phase->clear();
+    updateAllRegisters();
+    updateAllAdditionalValues();
+    updateAllFlags();
+    index = registers.getPC();
+    updateMemory(index);
+    highlightSourceLine(registers.getPC());
+    ui->statusbar->showMessage(tr("Machine state restored from %1").arg(QFileInfo(path).fileName()));
+}
@@ -5,9 +5,14 @@
 #include "lc3instructions.h"
 #include "ui_Logic.h"
 #include "lc3memory.h"
-#include "FileReadWrite.h"
+#include "lc3programfile.h"
 #include "assembler.h"
 #include "memorytablemodel.h"
+#include "memorysearch.h"
+#include "incrementalassembler.h"
+#include "lc3checkpoint.h"
+#include <QFutureWatcher>
+#include <QTimer>
 extern LC3Registers registers;
 extern int index;
 extern LC3Memory memory;
@@ -19,7 +24,7 @@ namespace Ui {
 class Logic;
 }
 
-class Logic : public QMainWindow
+class Logic : public QMainWindow, public LC3MemoryObserver
 {
     Q_OBJECT
 
@@ -27,6 +32,8 @@ public:
     explicit Logic(QWidget *parent = nullptr);
     ~Logic();
 
+    void memoryChanged(std::span<const LC3MemoryRange> ranges) override;
+
 private slots:
 
     void on_Upload_code_clicked();
@@ -40,6 +47,18 @@ private slots:
 
     void on_SampleCode_clicked();
 
+    void on_memoryFind_clicked();
+
+    void on_memorySnapshot_clicked();
+
+    void on_memoryDiff_clicked();
+
+    void on_saveState_clicked();
+
+    void on_loadState_clicked();
+
+    void startBackgroundAssembly();
+
 private:
     Ui::lc3 *ui;
     MemoryTableModel *memoryModel;
@@ -57,6 +76,30 @@ private:
     void updateAllFlags();
     void updateAllAdditionalValues();
     void updateRegisters();
+    void highlightSourceLine(uint16_t address);
+    void showCacheStats();
+
+    bool parseSearchPattern(const QString &text, std::vector<uint16_t> &pattern);
+
+    // Find / Diff on the memory table
+    QString lastFindText;
+    std::vector<uint16_t> findHits;
+    std::size_t findCursor = 0;
+    LC3MemoryImage memorySnapshot;
+    bool hasSnapshot = false;
+    std::vector<LC3MemoryRange> highlightedRanges;
+
+    // Save State / Load State; files are written in the background
+    LC3Checkpointer checkpointer;
+
+    // Re-assembles the editor text in the background a moment after each edit
+    bool incrementalImageReady();
+    IncrementalAssembler incremental;
+    QTimer reassembleTimer;
+    QFutureWatcher<void> reassembleWatcher;
+    quint64 editGeneration = 0;      // Bumped on every edit
+    quint64 runningGeneration = 0;   // Edit the running update was started from
+    quint64 assembledGeneration = 0; // Edit the incremental image reflects
 };
 
 #endif // LOGIC_H
@@ -0,0 +1,23 @@
+#include "asmdiagnostics.h"
+#include <QDebug>
+
+static thread_local AsmDiagnostics *currentSink = nullptr;
+
+AsmDiagnosticCollector::AsmDiagnosticCollector(AsmDiagnostics &sink)
+    : previous(currentSink)
+{
+    currentSink = &sink;
+}
+
+AsmDiagnosticCollector::~AsmDiagnosticCollector()
+{
+    currentSink = previous;
+}
+
+void reportAssemblyError(int line, const QString &message)
+{
+    if (currentSink)
+        currentSink->append({line, message});
+    else
+        qWarning().noquote() << message;
+}
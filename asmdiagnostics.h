@@ -0,0 +1,35 @@
+#ifndef ASMDIAGNOSTICS_H
+#define ASMDIAGNOSTICS_H
+
+#include <QString>
+#include <QVector>
+
+// One problem found while assembling. line is the 1-based source line, or 0 for
+// problems that belong to no line (a missing file, a link error between modules).
+struct AsmDiagnostic
+{
+    int line = 0;
+    QString message;
+};
+
+using AsmDiagnostics = QVector<AsmDiagnostic>;
+
+// Collects every diagnostic reported on this thread while it is alive. Collectors
+// nest; the innermost one receives. The assembler itself never shows anything, so
+// a caller can assemble at full speed and present the list however it likes.
+class AsmDiagnosticCollector
+{
+public:
+    explicit AsmDiagnosticCollector(AsmDiagnostics &sink);
+    ~AsmDiagnosticCollector();
+    AsmDiagnosticCollector(const AsmDiagnosticCollector &) = delete;
+    AsmDiagnosticCollector &operator=(const AsmDiagnosticCollector &) = delete;
+
+private:
+    AsmDiagnostics *previous;
+};
+
+// Hands the diagnostic to the current collector, or logs it with qWarning if there is none
+void reportAssemblyError(int line, const QString &message);
+
+#endif // ASMDIAGNOSTICS_H
@@ -0,0 +1,179 @@
+#include "asmlexer.h"
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+
+AsmArena::AsmArena(std::size_t blockSize)
+    : blockSize(blockSize)
+{
+}
+
+char *AsmArena::allocate(std::size_t size)
+{
+    if (size > remaining) {
+        std::size_t length = std::max(size, blockSize);
+        blocks.push_back(std::make_unique<char[]>(length));
+        cursor = blocks.back().get();
+        remaining = length;
+    }
+    char *result = cursor;
+    cursor += size;
+    remaining -= size;
+    return result;
+}
+
+std::string_view AsmArena::store(std::string_view text)
+{
+    char *copy = allocate(text.size());
+    std::memcpy(copy, text.data(), text.size());
+    return std::string_view(copy, text.size());
+}
+
+void AsmArena::reset()
+{
+    blocks.clear();
+    cursor = nullptr;
+    remaining = 0;
+}
+
+bool asmIsSpace(char ch)
+{
+    return ch == ' ' || ch == '\t' || ch == '\r' || ch == '\v' || ch == '\f';
+}
+
+AsmLexer::AsmLexer(std::string_view source, uint32_t firstLine)
+    : source(source), lineNumber(firstLine)
+{
+}
+
+bool AsmLexer::nextLine(AsmLine &line)
+{
+    unterminated = false;
+
+    while (position < source.size()) {
+        std::size_t lineStart = position;
+        std::size_t lineEnd = source.find('\n', lineStart);
+        if (lineEnd == std::string_view::npos)
+            lineEnd = source.size();
+        position = lineEnd + 1;
+        uint32_t number = lineNumber++;
+
+        line.tokens.clear();
+        bool labelComma = false;
+        std::size_t i = lineStart;
+        while (i < lineEnd) {
+            char ch = source[i];
+            if (asmIsSpace(ch)) {
+                ++i;
+            } else if (ch == ',') {
+                if (line.tokens.size() == 1 && i == lineStart + (line.tokens[0].column - 1) + line.tokens[0].text.size())
+                    labelComma = true; // "LABEL," with the comma attached
+                ++i;
+            } else if (ch == ';') {
+                break;
+            } else if (ch == '"') {
+                std::size_t begin = i + 1;
+                std::size_t end = begin;
+                while (end < lineEnd && source[end] != '"') {
+                    end += (source[end] == '\\' && end + 1 < lineEnd) ? 2 : 1;
+                }
+                if (end >= lineEnd)
+                    unterminated = true;
+                line.tokens.push_back({AsmTokenKind::String, decodeString(begin, std::min(end, lineEnd)),
+                                       number, static_cast<uint32_t>(i - lineStart + 1)});
+                i = std::min(end + 1, lineEnd);
+            } else {
+                std::size_t begin = i;
+                while (i < lineEnd && !asmIsSpace(source[i]) && source[i] != ',' && source[i] != ';')
+                    ++i;
+                line.tokens.push_back({AsmTokenKind::Word, source.substr(begin, i - begin),
+                                       number, static_cast<uint32_t>(begin - lineStart + 1)});
+            }
+        }
+
+        if (line.tokens.empty())
+            continue;
+
+        std::size_t textEnd = lineEnd;
+        if (textEnd > lineStart && source[textEnd - 1] == '\r')
+            --textEnd;
+        line.text = source.substr(lineStart, textEnd - lineStart);
+        line.number = number;
+        if (labelComma && line.tokens[0].kind == AsmTokenKind::Word) {
+            line.label = &line.tokens[0];
+            line.statement = std::span<const AsmToken>(line.tokens).subspan(1);
+        } else {
+            line.label = nullptr;
+            line.statement = std::span<const AsmToken>(line.tokens);
+        }
+        return true;
+    }
+    return false;
+}
+
+// Escape-free literals stay views into the source; the rest are decoded into the arena
+std::string_view AsmLexer::decodeString(std::size_t begin, std::size_t end)
+{
+    std::string_view raw = source.substr(begin, end - begin);
+    if (raw.find('\\') == std::string_view::npos)
+        return raw;
+
+    char *out = arena.allocate(raw.size());
+    std::size_t length = 0;
+    for (std::size_t i = 0; i < raw.size(); ++i) {
+        char ch = raw[i];
+        if (ch == '\\' && i + 1 < raw.size()) {
+            switch (raw[++i]) {
+            case 'n': ch = '\n'; break;
+            case 't': ch = '\t'; break;
+            case 'r': ch = '\r'; break;
+            case '0': ch = '\0'; break;
+            case 'e': ch = '\x1b'; break;
+            default: ch = raw[i]; break; // \" \\ and anything else stand for themselves
+            }
+        }
+        out[length++] = ch;
+    }
+    return std::string_view(out, length);
+}
+
+bool asmParseInteger(std::string_view text, int base, int &value)
+{
+    bool negative = false;
+    if (!text.empty() && (text[0] == '-' || text[0] == '+')) {
+        negative = text[0] == '-';
+        text.remove_prefix(1);
+    }
+    if (base == 16) {
+        if (text.size() > 2 && text[0] == '0' && (text[1] == 'x' || text[1] == 'X'))
+            text.remove_prefix(2);
+        else if (text.size() > 1 && (text[0] == 'x' || text[0] == 'X'))
+            text.remove_prefix(1);
+    }
+    if (text.empty())
+        return false;
+
+    long result = 0;
+    auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), result, base);
+    if (error != std::errc() || end != text.data() + text.size() || result > 0x7FFFFFFF)
+        return false;
+    value = static_cast<int>(negative ? -result : result);
+    return true;
+}
+
+bool asmParseRegister(std::string_view text, int &reg)
+{
+    if (text.size() != 2 || text[0] != 'R' || text[1] < '0' || text[1] > '7')
+        return false;
+    reg = text[1] - '0';
+    return true;
+}
+
+bool asmParseImmediate(std::string_view text, int &value)
+{
+    if (!text.empty() && text[0] == '#')
+        text.remove_prefix(1);
+    if (!text.empty() && (text[0] == 'x' || text[0] == 'X' || (text.size() > 1 && text[0] == '0' && (text[1] == 'x' || text[1] == 'X'))))
+        return asmParseInteger(text, 16, value);
+    return asmParseInteger(text, 10, value);
+}
@@ -0,0 +1,93 @@
+#ifndef ASMLEXER_H
+#define ASMLEXER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string_view>
+#include <vector>
+
+// Bump allocator for the little data the lexer has to own (decoded string
+// literals). Blocks are only released when the arena is destroyed.
+class AsmArena
+{
+public:
+    explicit AsmArena(std::size_t blockSize = 64 * 1024);
+
+    char *allocate(std::size_t size);
+    std::string_view store(std::string_view text);
+    void reset();
+
+private:
+    std::size_t blockSize;
+    std::vector<std::unique_ptr<char[]>> blocks;
+    char *cursor = nullptr;
+    std::size_t remaining = 0;
+};
+
+enum class AsmTokenKind : uint8_t
+{
+    Word,   // Mnemonics, registers, labels, numbers: any run of non-separator bytes
+    String  // "..." with escapes decoded; text excludes the quotes
+};
+
+struct AsmToken
+{
+    AsmTokenKind kind;
+    std::string_view text;
+    uint32_t line;   // 1-based
+    uint32_t column; // 1-based, in bytes
+};
+
+// One source line holding at least one token. Commas are separators and do not
+// appear as tokens; a leading word written as "LABEL," becomes the label.
+// label and statement point into tokens, so lines can be moved but not copied.
+struct AsmLine
+{
+    AsmLine() = default;
+    AsmLine(const AsmLine &) = delete;
+    AsmLine &operator=(const AsmLine &) = delete;
+    AsmLine(AsmLine &&) = default;
+    AsmLine &operator=(AsmLine &&) = default;
+
+    std::string_view text;               // The whole line, without the newline
+    uint32_t number = 0;                 // 1-based line number
+    const AsmToken *label = nullptr;     // Set when the line starts with "LABEL,"
+    std::span<const AsmToken> statement; // Mnemonic followed by its operands; may be empty
+    std::vector<AsmToken> tokens;        // Backing storage, reused from line to line
+};
+
+// Single-pass lexer over a UTF-8 buffer. Tokens are views into the buffer (or into
+// the lexer's arena), so the buffer must outlive every token handed out. Blank and
+// comment-only lines are skipped.
+class AsmLexer
+{
+public:
+    explicit AsmLexer(std::string_view source, uint32_t firstLine = 1);
+
+    // Fills line with the next line that has tokens; false at end of input
+    bool nextLine(AsmLine &line);
+
+    // Set when a string literal is missing its closing quote on the last line read
+    bool unterminatedString() const { return unterminated; }
+
+    std::size_t offset() const { return position; }
+
+private:
+    std::string_view decodeString(std::size_t begin, std::size_t end);
+
+    std::string_view source;
+    std::size_t position = 0;
+    uint32_t lineNumber;
+    bool unterminated = false;
+    AsmArena arena;
+};
+
+// Allocation-free operand parsing
+bool asmIsSpace(char ch);
+bool asmParseInteger(std::string_view text, int base, int &value); // Optional sign; "0x"/"x" allowed for base 16
+bool asmParseRegister(std::string_view text, int &reg);            // R0 - R7
+bool asmParseImmediate(std::string_view text, int &value);         // #12, #-3, #x1F, x1F, 0x1F or plain decimal
+
+#endif // ASMLEXER_H
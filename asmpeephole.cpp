@@ -0,0 +1,455 @@
+#include "asmpeephole.h"
+#include "AssemblerLogic.h"
+#include <QSet>
+#include <vector>
+
+namespace {
+
+struct Statement
+{
+    enum class Kind { Instruction, Other, Org, End };
+
+    Kind kind = Kind::Other;
+    uint32_t line = 0;             // 1-based
+    QString label;
+    std::vector<std::string> tokens;
+    uint16_t word = 0;             // Encoding with any PC offset left zero
+    QString target;                // Label of the PC offset, if any
+    uint8_t targetWidth = 0;
+    uint32_t size = 0;             // Words taken
+    uint16_t org = 0;
+    uint32_t section = 0;          // ORG sections seen before this statement
+    uint16_t address = 0;
+
+    bool removed = false;
+    bool rewritten = false;
+
+    unsigned opcode() const { return word >> 12; }
+    int field(int shift) const { return (word >> shift) & 7; }
+    bool immediate() const { return word & 0x20; }
+
+    QString text() const
+    {
+        QString result = QString::fromStdString(tokens[0]);
+        for (std::size_t i = 1; i < tokens.size(); ++i)
+            result += (i == 1 ? " " : ", ") + QString::fromStdString(tokens[i]);
+        return result;
+    }
+};
+
+enum Opcode : unsigned { BR = 0x0, ADD = 0x1, LD = 0x2, ST = 0x3, JSR = 0x4, AND = 0x5, LDR = 0x6, STR = 0x7,
+                         RTI = 0x8, NOT = 0x9, LDI = 0xA, STI = 0xB, JMP = 0xC, LEA = 0xE, TRAP = 0xF };
+
+bool setsConditionCodes(const Statement &s)
+{
+    switch (s.opcode())
+    {
+    case ADD: case AND: case NOT: case LD: case LDI: case LDR:
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool isControl(const Statement &s)
+{
+    switch (s.opcode())
+    {
+    case BR: case JSR: case JMP: case RTI: case TRAP:
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool isStore(const Statement &s)
+{
+    return s.opcode() == ST || s.opcode() == STI || s.opcode() == STR;
+}
+
+bool reads(const Statement &s, int reg)
+{
+    switch (s.opcode())
+    {
+    case ADD: case AND:
+        return s.field(6) == reg || (!s.immediate() && (s.word & 7) == reg);
+    case NOT: case LDR: case JMP:
+        return s.field(6) == reg;
+    case ST: case STI:
+        return s.field(9) == reg;
+    case STR:
+        return s.field(9) == reg || s.field(6) == reg;
+    case JSR:
+        return !(s.word & 0x0800) && s.field(6) == reg;
+    default:
+        return false;
+    }
+}
+
+// Destination register, or -1
+int writes(const Statement &s)
+{
+    switch (s.opcode())
+    {
+    case ADD: case AND: case NOT: case LD: case LDI: case LDR: case LEA:
+        return s.field(9);
+    case JSR:
+        return 7;
+    default:
+        return -1;
+    }
+}
+
+bool isUnconditionalBranch(const Statement &s)
+{
+    return s.kind == Statement::Kind::Instruction && s.opcode() == BR && (s.word & 0x0E00) == 0x0E00;
+}
+
+class Optimizer
+{
+public:
+    Optimizer(std::vector<Statement> &statements, const AsmSymbolTable &labels, QStringList &report)
+        : statements(statements), labels(labels), report(report)
+    {
+        for (const AsmSymbol &symbol : labels)
+            labelled.insert(symbol.address);
+        for (std::size_t i = 0; i < statements.size(); ++i)
+        {
+            if (statements[i].kind == Statement::Kind::Instruction)
+                byAddress.insert(statements[i].address, static_cast<int>(i));
+        }
+    }
+
+    bool pass()
+    {
+        bool changed = false;
+        for (std::size_t i = 0; i < statements.size(); ++i)
+        {
+            if (!live(i))
+                continue;
+            while (foldAdds(i))
+                changed = true; // A run of ADDs folds into its first
+            changed |= dropReload(i) || dropDeadClear(i) || threadBranch(i);
+        }
+        return changed;
+    }
+
+private:
+    bool live(std::size_t i) const
+    {
+        return statements[i].kind == Statement::Kind::Instruction && !statements[i].removed;
+    }
+
+    // A label on a line of its own, EXPORT/IMPORT or an empty block: takes no words
+    bool isLabelOnly(std::size_t i) const
+    {
+        return statements[i].kind == Statement::Kind::Other && statements[i].size == 0;
+    }
+
+    // The instruction that runs after i when i falls through, or -1 at anything else
+    int next(std::size_t i) const
+    {
+        for (std::size_t j = i + 1; j < statements.size(); ++j)
+        {
+            if (statements[j].removed)
+                continue;
+            if (isLabelOnly(j))
+                continue;
+            return live(j) ? static_cast<int>(j) : -1;
+        }
+        return -1;
+    }
+
+    // Whether a branch can land on i: a label names it, or names a removed
+    // statement just before it
+    bool isTarget(std::size_t i) const
+    {
+        if (labelled.contains(statements[i].address))
+            return true;
+        for (std::size_t j = i; j-- > 0 && (statements[j].removed || isLabelOnly(j));)
+        {
+            if (labelled.contains(statements[j].address))
+                return true;
+        }
+        return false;
+    }
+
+    // Whether the condition codes left by i are overwritten before anything reads them
+    bool conditionCodesDeadAfter(std::size_t i) const
+    {
+        for (int j = next(i); j >= 0; j = next(j))
+        {
+            if (setsConditionCodes(statements[j]))
+                return true;
+            if (!isStore(statements[j]))
+                return false;
+        }
+        return false;
+    }
+
+    void remove(std::size_t i, const QString &why)
+    {
+        statements[i].removed = true;
+        report.append(QString("Line %1: removed %2 (%3)").arg(statements[i].line).arg(statements[i].text(), why));
+    }
+
+    bool foldAdds(std::size_t i)
+    {
+        Statement &first = statements[i];
+        if (first.opcode() != ADD || !first.immediate() || first.field(9) != first.field(6))
+            return false;
+        int j = next(i);
+        if (j < 0 || isTarget(j))
+            return false;
+        Statement &second = statements[j];
+        if (second.opcode() != ADD || !second.immediate() || second.field(9) != first.field(9) || second.field(6) != first.field(9))
+            return false;
+
+        int sum = lc3SignExtend(first.word, 5) + lc3SignExtend(second.word, 5);
+        uint16_t packed;
+        if (!lc3SignedField(sum, 5, packed))
+            return false;
+        first.word = static_cast<uint16_t>((first.word & ~0x1F) | packed);
+        first.tokens[3] = "#" + std::to_string(sum);
+        first.rewritten = true;
+        remove(j, QString("folded into line %1 as %2").arg(first.line).arg(first.text()));
+        return true;
+    }
+
+    bool dropReload(std::size_t i)
+    {
+        const Statement &store = statements[i];
+        if (store.opcode() != ST || !labels.contains(store.target))
+            return false;
+        int j = next(i);
+        if (j < 0 || isTarget(j))
+            return false;
+        const Statement &load = statements[j];
+        if (load.opcode() != LD || load.field(9) != store.field(9) || !labels.contains(load.target)
+            || labels.value(load.target) != labels.value(store.target) || !conditionCodesDeadAfter(j))
+            return false;
+        remove(j, QString("R%1 already holds %2 from line %3").arg(load.field(9)).arg(load.target).arg(store.line));
+        return true;
+    }
+
+    bool dropDeadClear(std::size_t i)
+    {
+        const Statement &clear = statements[i];
+        if (clear.opcode() != AND || !clear.immediate() || (clear.word & 0x1F) != 0)
+            return false;
+        int reg = clear.field(9);
+        bool conditionCodesKilled = false;
+        for (int j = next(i); j >= 0; j = next(j))
+        {
+            const Statement &s = statements[j];
+            if (reads(s, reg) || isControl(s))
+                return false;
+            if (writes(s) == reg)
+            {
+                if (!conditionCodesKilled && !setsConditionCodes(s))
+                    return false;
+                remove(i, QString("R%1 is overwritten on line %2 before it is read").arg(reg).arg(s.line));
+                return true;
+            }
+            conditionCodesKilled |= setsConditionCodes(s);
+        }
+        return false;
+    }
+
+    // The live instruction a branch to address actually reaches, or -1
+    int landing(uint16_t address) const
+    {
+        if (byAddress.count(address) != 1)
+            return -1; // Overlapping ORG sections: leave it alone
+        int i = byAddress.value(address);
+        if (statements[i].removed)
+            i = next(i);
+        return i;
+    }
+
+    bool threadBranch(std::size_t i)
+    {
+        Statement &branch = statements[i];
+        if (branch.opcode() != BR || !labels.contains(branch.target))
+            return false;
+
+        QString target = branch.target;
+        QSet<QString> seen{target};
+        for (;;)
+        {
+            int hop = landing(labels.value(target));
+            if (hop < 0 || !isUnconditionalBranch(statements[hop]) || !labels.contains(statements[hop].target))
+                break;
+            const QString &further = statements[hop].target;
+            if (seen.contains(further))
+                return false; // A loop of branches; leave it as written
+            int end = landing(labels.value(further));
+            uint16_t packed;
+            if (end < 0 || statements[end].section != branch.section
+                || !lc3SignedField(static_cast<int16_t>(labels.value(further) - branch.address - 1), branch.targetWidth, packed))
+                break;
+            seen.insert(further);
+            target = further;
+        }
+        if (target == branch.target)
+            return false;
+
+        report.append(QString("Line %1: %2 now branches to %3 (%4 is an unconditional branch)")
+                          .arg(branch.line).arg(branch.text(), target, branch.target));
+        branch.target = target;
+        branch.tokens[1] = target.toStdString();
+        branch.rewritten = true;
+        return true;
+    }
+
+    std::vector<Statement> &statements;
+    const AsmSymbolTable &labels;
+    QStringList &report;
+    QSet<uint16_t> labelled;
+    QMultiMap<uint16_t, int> byAddress;
+};
+
+// Lays the statements out again without the removed ones and checks every PC
+// offset still reaches its label. Only sections that keep their origin move, but
+// a reference from one section into another can stretch.
+bool offsetsStillFit(const std::vector<Statement> &statements)
+{
+    AsmSymbolTable moved;
+    std::vector<uint16_t> addresses(statements.size());
+    uint16_t address = 0x3000;
+    for (std::size_t i = 0; i < statements.size(); ++i)
+    {
+        const Statement &s = statements[i];
+        if (!s.label.isEmpty())
+            moved.insert(s.label, address); // Before ORG moves on: a label on an ORG line ends the previous section
+        if (s.kind == Statement::Kind::Org)
+            address = s.org;
+        addresses[i] = address;
+        if (!s.removed && s.kind != Statement::Kind::Org)
+            address += s.size;
+    }
+    for (std::size_t i = 0; i < statements.size(); ++i)
+    {
+        const Statement &s = statements[i];
+        uint16_t packed;
+        if (!s.removed && !s.target.isEmpty() && moved.contains(s.target)
+            && !lc3SignedField(static_cast<int16_t>(moved.value(s.target) - addresses[i] - 1), s.targetWidth, packed))
+            return false;
+    }
+    return true;
+}
+
+} // namespace
+
+std::string peepholeOptimize(std::string_view source, const AsmSymbolTable &labels, QStringList &report)
+{
+    // Statements up to END, laid out as processLabels() does
+    std::vector<Statement> statements;
+    uint16_t address = 0x3000;
+    uint32_t section = 0;
+    AsmLexer lexer(source);
+    AsmLine line;
+    while (lexer.nextLine(line))
+    {
+        Statement &s = statements.emplace_back();
+        s.line = line.number;
+        s.address = address;
+        if (line.label)
+            s.label = QString::fromUtf8(line.label->text.data(), static_cast<int>(line.label->text.size()));
+        AsmTokens tokens = line.statement;
+        if (tokens.empty())
+            continue;
+        for (const AsmToken &token : tokens)
+            s.tokens.emplace_back(token.text);
+
+        const Lc3InstructionDesc *desc = lc3FindMnemonic(tokens[0].text);
+        if (desc && desc->kind == Lc3EntryKind::End)
+        {
+            s.kind = Statement::Kind::End;
+            break;
+        }
+        if (desc && desc->kind == Lc3EntryKind::Org)
+        {
+            int origin = 0;
+            if (tokens.size() == 2 && asmParseInteger(tokens[1].text, 16, origin) && origin >= 0 && origin <= 0xFFFF)
+            {
+                s.kind = Statement::Kind::Org;
+                s.org = address = static_cast<uint16_t>(origin);
+                s.address = address;
+                s.section = ++section;
+            }
+            continue;
+        }
+        s.section = section;
+        if (desc && (desc->kind == Lc3EntryKind::Export || desc->kind == Lc3EntryKind::Import))
+            continue;
+        if (desc && desc->kind == Lc3EntryKind::Block)
+        {
+            AsmBlock block;
+            QString error;
+            expandBlockDirective(tokens, block, error);
+            s.size = block.size;
+        }
+        else
+        {
+            QString error;
+            s.size = 1;
+            if (desc && desc->kind == Lc3EntryKind::Instruction
+                && assembleDeferred(tokens, s.word, s.target, s.targetWidth, error))
+                s.kind = Statement::Kind::Instruction;
+        }
+        address += s.size;
+    }
+
+    QStringList changes;
+    Optimizer optimizer(statements, labels, changes);
+    while (optimizer.pass())
+        ;
+    if (changes.isEmpty())
+        return std::string(source);
+    if (!offsetsStillFit(statements))
+    {
+        report.append("Optimization skipped: a PC offset between ORG sections would no longer fit");
+        return std::string(source);
+    }
+    report.append(changes);
+
+    // Same lines as the input, with removed statements reduced to their label
+    QMap<uint32_t, const Statement *> edits;
+    for (const Statement &s : statements)
+    {
+        if (s.removed || s.rewritten)
+            edits.insert(s.line, &s);
+    }
+    std::string result;
+    result.reserve(source.size());
+    uint32_t number = 1;
+    std::size_t start = 0;
+    while (start <= source.size())
+    {
+        std::size_t end = source.find('\n', start);
+        if (end == std::string_view::npos)
+            end = source.size();
+        if (const Statement *s = edits.value(number))
+        {
+            if (!s->label.isEmpty())
+                result += s->label.toStdString() + ",";
+            if (!s->removed)
+                result += (s->label.isEmpty() ? "" : " ") + s->text().toStdString();
+        }
+        else
+            result.append(source.substr(start, end - start));
+        if (end < source.size())
+            result += '\n';
+        start = end + 1;
+        number++;
+    }
+    return result;
+}
+
+uint32_t assembleOptimized(std::string_view source, AsmSymbolTable &labels, LC3Memory &memory, QStringList &report)
+{
+    std::string optimized = peepholeOptimize(source, processLabels(source), report);
+    labels = processLabels(optimized);
+    return assembleInstructionSetA(optimized, labels, memory);
+}
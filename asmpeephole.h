@@ -0,0 +1,33 @@
+#ifndef ASMPEEPHOLE_H
+#define ASMPEEPHOLE_H
+
+#include "asmsymbols.h"
+#include "lc3memory.h"
+#include <QString>
+#include <QStringList>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Peephole optimizer over straight-line runs of instructions. It works on the
+// source after label resolution and returns new source with the same number of
+// lines, so later error messages still point at the lines the user wrote. A
+// removed statement leaves its label behind on an otherwise empty line, and the
+// label then names the next instruction.
+//
+// Rewrites, each only where no other path can observe the difference:
+//  - ST Rx, L followed by LD Rx, L: the load is dropped if nothing branches to it
+//    and its condition codes are overwritten before they are read
+//  - ADD Rx, Rx, #a followed by ADD Rx, Rx, #b: one ADD of a+b, if it fits imm5
+//  - AND Rx, Ry, #0 whose result is overwritten before Rx is read
+//  - BR to an unconditional BR: branches straight to the final target
+//
+// report gets one "Line N: ..." entry per change. If a PC offset anywhere would no
+// longer fit after the rewrite, the source is returned unchanged.
+std::string peepholeOptimize(std::string_view source, const AsmSymbolTable &labels, QStringList &report);
+
+// The two-pass assembler with the optimizer between label resolution and the
+// final encode. Fills labels with the optimized layout.
+uint32_t assembleOptimized(std::string_view source, AsmSymbolTable &labels, LC3Memory &memory, QStringList &report);
+
+#endif // ASMPEEPHOLE_H
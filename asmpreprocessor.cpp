@@ -0,0 +1,375 @@
+#include "asmpreprocessor.h"
+#include "asmdiagnostics.h"
+#include "lc3isa.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QStringList>
+#include <algorithm>
+#include <optional>
+#include <utility>
+
+// Deeper than this is taken to be a macro or include that uses itself
+static constexpr int MaxDepth = 64;
+
+// Copies the tokens out of the lexer's line buffer; decoded strings move to the file's arena
+static void lexSource(std::string_view text, AsmSourceFile &file)
+{
+    AsmLexer lexer(text);
+    AsmLine lexed;
+    while (lexer.nextLine(lexed))
+    {
+        AsmSourceFile::Line line;
+        line.text = lexed.text;
+        line.number = lexed.number;
+        line.hasLabel = lexed.label != nullptr;
+        line.tokens = lexed.tokens;
+        for (AsmToken &token : line.tokens)
+        {
+            if (token.kind == AsmTokenKind::String)
+                token.text = file.strings.store(token.text);
+        }
+        file.lines.push_back(std::move(line));
+    }
+}
+
+std::shared_ptr<const AsmSourceFile> AsmIncludeCache::load(const QString &path)
+{
+    QFileInfo info(path);
+    QDateTime modified = info.lastModified();
+    Entry entry = entries.value(path);
+    if (entry.file && info.exists() && entry.modified == modified)
+    {
+        cacheHits++;
+        return entry.file;
+    }
+
+    cacheMisses++;
+    QFile input(path);
+    if (!input.open(QIODevice::ReadOnly))
+    {
+        entries.remove(path);
+        return nullptr;
+    }
+    QByteArray data = input.readAll();
+    auto file = std::make_shared<AsmSourceFile>();
+    file->path = path;
+    file->text.assign(data.constData(), static_cast<std::size_t>(data.size()));
+    lexSource(file->text, *file);
+    entries.insert(path, {modified, file});
+    return file;
+}
+
+bool asmNeedsPreprocessing(std::string_view source)
+{
+    return source.find(".INCLUDE") != std::string_view::npos || source.find(".MACRO") != std::string_view::npos;
+}
+
+namespace {
+
+struct Macro
+{
+    std::vector<std::string> parameters; // Without the backslash
+    std::vector<std::string> locals;     // Labels defined in the body
+    std::vector<std::pair<const AsmSourceFile::Line *, AsmOrigin>> body;
+    std::shared_ptr<const AsmSourceFile> file; // Owns the body lines
+    QString directory;                   // Includes in the body are relative to the defining file
+};
+
+// The argument as written, with the quotes of a string literal
+std::string_view rawToken(const AsmSourceFile::Line &line, const AsmToken &token)
+{
+    if (token.kind == AsmTokenKind::Word)
+        return token.text;
+    std::size_t begin = token.column - 1, end = begin + 1;
+    while (end < line.text.size() && line.text[end] != '"')
+        end += line.text[end] == '\\' ? 2 : 1;
+    return line.text.substr(begin, std::min(end + 1, line.text.size()) - begin);
+}
+
+class Preprocessor
+{
+public:
+    Preprocessor(AsmIncludeCache &cache, AsmPreprocessed &result) : cache(cache), result(result) {}
+
+    void run(const std::shared_ptr<const AsmSourceFile> &file, const QString &directory, int depth);
+
+private:
+    void processLine(const AsmSourceFile::Line &line, const AsmOrigin &origin,
+                     const std::shared_ptr<const AsmSourceFile> &file, const QString &directory, int depth);
+    void define(const AsmSourceFile::Line &line, const AsmOrigin &origin,
+                const std::shared_ptr<const AsmSourceFile> &file, const QString &directory);
+    void include(const AsmSourceFile::Line &line, const AsmOrigin &origin, const QString &directory, int depth);
+    void expand(const Macro &macro, const AsmSourceFile::Line &line, const AsmOrigin &origin, int depth);
+    std::string substitute(const AsmSourceFile::Line &line, const Macro &macro,
+                           const std::vector<std::string_view> &arguments, int expansion) const;
+
+    void emit(std::string_view text, const AsmOrigin &origin);
+    void emitLabel(const AsmSourceFile::Line &line, const AsmOrigin &origin);
+    void error(const AsmOrigin &origin, const QString &message) const;
+
+    AsmIncludeCache &cache;
+    AsmPreprocessed &result;
+    QHash<QString, std::shared_ptr<const Macro>> macros; // Shared so an expansion survives new definitions
+    std::optional<Macro> definition; // The .MACRO being read
+    QString definitionName;
+    AsmOrigin definitionOrigin;
+    QStringList includeStack;
+    int topLine = 0;     // Main-source line being expanded
+    int expansions = 0;
+};
+
+void Preprocessor::run(const std::shared_ptr<const AsmSourceFile> &file, const QString &directory, int depth)
+{
+    for (const AsmSourceFile::Line &line : file->lines)
+    {
+        if (depth == 0)
+            topLine = static_cast<int>(line.number);
+        processLine(line, {file->path, line.number}, file, directory, depth);
+    }
+    if (definition && definition->file == file)
+    {
+        error(definitionOrigin, "Missing .ENDM for macro " + definitionName);
+        definition.reset();
+    }
+}
+
+void Preprocessor::processLine(const AsmSourceFile::Line &line, const AsmOrigin &origin,
+                               const std::shared_ptr<const AsmSourceFile> &file, const QString &directory, int depth)
+{
+    std::span<const AsmToken> statement = line.statement();
+    std::string_view mnemonic = statement.empty() ? std::string_view() : statement[0].text;
+
+    if (definition)
+    {
+        if (mnemonic == ".ENDM")
+        {
+            macros.insert(definitionName, std::make_shared<const Macro>(std::move(*definition)));
+            definition.reset();
+        }
+        else if (mnemonic == ".MACRO")
+            error(origin, "Nested .MACRO");
+        else
+        {
+            if (const AsmToken *label = line.label())
+                definition->locals.emplace_back(label->text);
+            definition->body.emplace_back(&line, origin);
+        }
+        return;
+    }
+
+    if (mnemonic == ".MACRO")
+        define(line, origin, file, directory);
+    else if (mnemonic == ".ENDM")
+        error(origin, ".ENDM without .MACRO");
+    else if (mnemonic == ".INCLUDE")
+        include(line, origin, directory, depth);
+    else if (std::shared_ptr<const Macro> macro = macros.value(QString::fromUtf8(mnemonic.data(), static_cast<int>(mnemonic.size()))))
+        expand(*macro, line, origin, depth);
+    else
+        emit(line.text, origin);
+}
+
+void Preprocessor::define(const AsmSourceFile::Line &line, const AsmOrigin &origin,
+                          const std::shared_ptr<const AsmSourceFile> &file, const QString &directory)
+{
+    std::span<const AsmToken> statement = line.statement();
+    if (statement.size() < 2 || statement[1].kind != AsmTokenKind::Word)
+    {
+        error(origin, ".MACRO needs a name");
+        return;
+    }
+    QString name = QString::fromUtf8(statement[1].text.data(), static_cast<int>(statement[1].text.size()));
+    if (lc3FindMnemonic(statement[1].text))
+        error(origin, "Macro name " + name + " is an instruction");
+    else if (macros.contains(name))
+        error(origin, "Macro " + name + " redefined");
+
+    Macro macro;
+    for (const AsmToken &parameter : statement.subspan(2))
+    {
+        std::string_view text = parameter.text;
+        if (!text.empty() && text[0] == '\\')
+            text.remove_prefix(1);
+        macro.parameters.emplace_back(text);
+    }
+    macro.file = file;
+    macro.directory = directory;
+    definition = std::move(macro);
+    definitionName = name;
+    definitionOrigin = origin;
+}
+
+void Preprocessor::include(const AsmSourceFile::Line &line, const AsmOrigin &origin, const QString &directory, int depth)
+{
+    std::span<const AsmToken> statement = line.statement();
+    if (statement.size() != 2 || statement[1].kind != AsmTokenKind::String)
+    {
+        error(origin, "Expected .INCLUDE \"file\"");
+        return;
+    }
+    QString path = QDir(directory).absoluteFilePath(QString::fromUtf8(statement[1].text.data(), static_cast<int>(statement[1].text.size())));
+    QString canonical = QFileInfo(path).canonicalFilePath();
+    if (!canonical.isEmpty())
+        path = canonical;
+    if (includeStack.contains(path) || depth >= MaxDepth)
+    {
+        error(origin, QFileInfo(path).fileName() + " includes itself");
+        return;
+    }
+    std::shared_ptr<const AsmSourceFile> file = cache.load(path);
+    if (!file)
+    {
+        error(origin, "Cannot read include file " + path);
+        return;
+    }
+
+    emitLabel(line, origin);
+    includeStack.append(path);
+    run(file, QFileInfo(path).absolutePath(), depth + 1);
+    includeStack.removeLast();
+}
+
+void Preprocessor::expand(const Macro &macro, const AsmSourceFile::Line &line, const AsmOrigin &origin, int depth)
+{
+    std::span<const AsmToken> statement = line.statement();
+    QString name = QString::fromUtf8(statement[0].text.data(), static_cast<int>(statement[0].text.size()));
+    if (statement.size() - 1 != macro.parameters.size())
+    {
+        error(origin, QString("Macro %1 takes %2 argument(s)").arg(name).arg(macro.parameters.size()));
+        return;
+    }
+    if (depth >= MaxDepth)
+    {
+        error(origin, "Macro " + name + " expands too deeply");
+        return;
+    }
+
+    std::vector<std::string_view> arguments;
+    for (const AsmToken &argument : statement.subspan(1))
+        arguments.push_back(rawToken(line, argument));
+
+    // The expanded body is lexed as a file of its own so it can use other macros
+    emitLabel(line, origin);
+    int expansion = ++expansions;
+    auto body = std::make_shared<AsmSourceFile>();
+    for (const auto &[bodyLine, bodyOrigin] : macro.body)
+    {
+        body->text += substitute(*bodyLine, macro, arguments, expansion);
+        body->text += '\n';
+    }
+    lexSource(body->text, *body);
+    for (const AsmSourceFile::Line &expanded : body->lines)
+        processLine(expanded, macro.body[expanded.number - 1].second, body, macro.directory, depth + 1);
+}
+
+// Replaces \parameter inside words and renames the body's own labels. String
+// literals are left alone.
+std::string Preprocessor::substitute(const AsmSourceFile::Line &line, const Macro &macro,
+                                     const std::vector<std::string_view> &arguments, int expansion) const
+{
+    std::string text;
+    std::size_t copied = 0;
+    for (const AsmToken &token : line.tokens)
+    {
+        if (token.kind != AsmTokenKind::Word)
+            continue;
+
+        std::string word;
+        if (std::find(macro.locals.begin(), macro.locals.end(), token.text) != macro.locals.end())
+            word = std::string(token.text) + "__" + std::to_string(expansion);
+        else
+        {
+            for (std::size_t i = 0; i < token.text.size(); ++i)
+            {
+                std::size_t match = macro.parameters.size(), length = 0;
+                if (token.text[i] == '\\')
+                {
+                    std::string_view rest = token.text.substr(i + 1);
+                    for (std::size_t p = 0; p < macro.parameters.size(); ++p)
+                    {
+                        const std::string &parameter = macro.parameters[p];
+                        if (parameter.size() > length && rest.substr(0, parameter.size()) == parameter)
+                            match = p, length = parameter.size();
+                    }
+                }
+                if (match < arguments.size())
+                {
+                    word += arguments[match];
+                    i += length;
+                }
+                else
+                    word += token.text[i];
+            }
+        }
+        if (word == token.text)
+            continue;
+
+        std::size_t begin = token.column - 1;
+        text.append(line.text.substr(copied, begin - copied));
+        text += word;
+        copied = begin + token.text.size();
+    }
+    text.append(line.text.substr(copied));
+    return text;
+}
+
+void Preprocessor::emit(std::string_view text, const AsmOrigin &origin)
+{
+    result.text.append(text);
+    result.text += '\n';
+    result.origins.push_back(origin);
+}
+
+void Preprocessor::emitLabel(const AsmSourceFile::Line &line, const AsmOrigin &origin)
+{
+    if (const AsmToken *label = line.label())
+        emit(std::string(label->text) + ",", origin);
+}
+
+void Preprocessor::error(const AsmOrigin &origin, const QString &message) const
+{
+    QString where = QString("line %1").arg(origin.line);
+    if (!origin.file.isEmpty())
+        where += " of " + QFileInfo(origin.file).fileName();
+    reportAssemblyError(topLine, message + " on " + where);
+}
+
+} // namespace
+
+void preprocessAssembly(std::string_view source, const QString &directory, AsmIncludeCache &cache, AsmPreprocessed &result)
+{
+    result.text.clear();
+    result.origins.clear();
+    auto main = std::make_shared<AsmSourceFile>();
+    lexSource(source, *main);
+    Preprocessor(cache, result).run(main, directory, 0);
+}
+
+std::string_view expandAssembly(std::string_view source, const QString &directory, AsmIncludeCache &cache, AsmPreprocessed &expanded)
+{
+    if (!asmNeedsPreprocessing(source))
+        return source;
+    preprocessAssembly(source, directory, cache, expanded);
+    return expanded.text;
+}
+
+void mapDiagnosticsToSource(AsmDiagnostics &diagnostics, qsizetype first, const AsmPreprocessed &expanded)
+{
+    for (qsizetype i = first; i < diagnostics.size(); ++i)
+    {
+        AsmDiagnostic &diagnostic = diagnostics[i];
+        if (diagnostic.line <= 0 || std::size_t(diagnostic.line) > expanded.origins.size())
+            continue;
+        const AsmOrigin &origin = expanded.origins[diagnostic.line - 1];
+        if (origin.file.isEmpty())
+        {
+            diagnostic.message += QString(" (source line %1)").arg(origin.line);
+            diagnostic.line = static_cast<int>(origin.line);
+        }
+        else
+        {
+            diagnostic.message += QString(" (line %1 of %2)").arg(origin.line).arg(QFileInfo(origin.file).fileName());
+        }
+    }
+}
@@ -0,0 +1,94 @@
+#ifndef ASMPREPROCESSOR_H
+#define ASMPREPROCESSOR_H
+
+#include "asmdiagnostics.h"
+#include "asmlexer.h"
+#include <QDateTime>
+#include <QHash>
+#include <QString>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// A source lexed once into lines of tokens. Tokens are views into text or into
+// strings, so a file is only ever handed out behind a shared_ptr.
+struct AsmSourceFile
+{
+    struct Line
+    {
+        std::string_view text;
+        uint32_t number = 0;
+        bool hasLabel = false;        // tokens[0] is the label
+        std::vector<AsmToken> tokens;
+
+        const AsmToken *label() const { return hasLabel ? &tokens[0] : nullptr; }
+        std::span<const AsmToken> statement() const { return std::span<const AsmToken>(tokens).subspan(hasLabel ? 1 : 0); }
+    };
+
+    QString path;             // Empty for the main source
+    std::string text;         // Contents of an include file; the main source is not copied
+    AsmArena strings;         // Decoded string literals
+    std::vector<Line> lines;  // Lines with tokens only
+};
+
+// Include files by path. An entry is lexed when it is first asked for and again
+// only when the file's modification time changes, so a batch of programs that
+// include the same libraries reads and lexes each library once.
+class AsmIncludeCache
+{
+public:
+    // The lexed file, or null if it cannot be read
+    std::shared_ptr<const AsmSourceFile> load(const QString &path);
+
+    int hits() const { return cacheHits; }
+    int misses() const { return cacheMisses; }
+
+private:
+    struct Entry
+    {
+        QDateTime modified;
+        std::shared_ptr<const AsmSourceFile> file;
+    };
+
+    QHash<QString, Entry> entries;
+    int cacheHits = 0;
+    int cacheMisses = 0;
+};
+
+// Where one line of preprocessed source came from. file is empty for the main source.
+struct AsmOrigin
+{
+    QString file;
+    uint32_t line = 0;
+};
+
+struct AsmPreprocessed
+{
+    std::string text;
+    std::vector<AsmOrigin> origins; // origins[n - 1] for line n of text
+};
+
+// True if source uses .INCLUDE or .MACRO. Sources without either go to the
+// assembler as they are, so their line numbers are unchanged.
+bool asmNeedsPreprocessing(std::string_view source);
+
+// Expands .INCLUDE "file" and .MACRO NAME p1, p2 ... .ENDM ahead of processLabels.
+// Include paths are relative to the including file, or to directory for the main
+// source. In a macro body \p1 stands for the first argument; labels defined in the
+// body are renamed for each expansion so a macro can be used more than once. A
+// label on an .INCLUDE or macro line is kept on a line of its own. Problems are
+// reported as diagnostics against the main-source line that led to them.
+void preprocessAssembly(std::string_view source, const QString &directory, AsmIncludeCache &cache, AsmPreprocessed &result);
+
+// The text to assemble: source itself, or its expansion into expanded when it
+// uses .INCLUDE or .MACRO
+std::string_view expandAssembly(std::string_view source, const QString &directory, AsmIncludeCache &cache, AsmPreprocessed &expanded);
+
+// Points assembler diagnostics from index first on, whose line numbers count lines
+// of expanded.text, back at the file and line each came from. Diagnostics on the
+// main source get its line number; others name the include file in the message.
+void mapDiagnosticsToSource(AsmDiagnostics &diagnostics, qsizetype first, const AsmPreprocessed &expanded);
+
+#endif // ASMPREPROCESSOR_H
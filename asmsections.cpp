@@ -0,0 +1,263 @@
+#include "asmsections.h"
+#include <QThreadPool>
+#include <QtConcurrent/QtConcurrentMap>
+#include <algorithm>
+#include <bitset>
+#include <cstring>
+
+static QString toQString(std::string_view text)
+{
+    return QString::fromUtf8(text.data(), static_cast<int>(text.size()));
+}
+
+// The word starting at i, as the lexer would cut it
+static std::string_view wordAt(std::string_view line, std::size_t &i)
+{
+    while (i < line.size() && asmIsSpace(line[i]))
+        ++i;
+    std::size_t begin = i;
+    while (i < line.size() && !asmIsSpace(line[i]) && line[i] != ',' && line[i] != ';' && line[i] != '"')
+        ++i;
+    return line.substr(begin, i - begin);
+}
+
+bool splitSections(std::string_view source, std::vector<AsmSection> &sections)
+{
+    sections.clear();
+    sections.emplace_back(); // Code before the first ORG starts at x3000
+
+    std::size_t sectionStart = 0;
+    std::size_t lineStart = 0;
+    uint32_t lineNumber = 1;
+    while (lineStart < source.size())
+    {
+        const void *newline = std::memchr(source.data() + lineStart, '\n', source.size() - lineStart);
+        std::size_t lineEnd = newline ? static_cast<const char *>(newline) - source.data() : source.size();
+        std::string_view line = source.substr(lineStart, lineEnd - lineStart);
+
+        std::size_t i = 0;
+        std::string_view label;
+        std::string_view word = wordAt(line, i);
+        if (!word.empty() && i < line.size() && line[i] == ',')
+        {
+            // "LABEL," with the comma attached; the lexer skips spaces and commas after it
+            label = word;
+            while (i < line.size() && (asmIsSpace(line[i]) || line[i] == ','))
+                ++i;
+            word = wordAt(line, i);
+        }
+
+        if (const Lc3InstructionDesc *desc = lc3FindMnemonic(word))
+        {
+            if (desc->kind == Lc3EntryKind::End)
+            {
+                sections.back().text = source.substr(sectionStart, lineEnd - sectionStart);
+                sections.back().ended = true;
+                return true;
+            }
+            if (desc->kind == Lc3EntryKind::Org)
+            {
+                int origin = 0;
+                if (!asmParseInteger(wordAt(line, i), 16, origin) || origin < 0 || origin > 0xFFFF)
+                    return false;
+                sections.back().text = source.substr(sectionStart, lineStart - sectionStart);
+
+                AsmSection &section = sections.emplace_back();
+                section.firstLine = lineNumber;
+                section.origin = static_cast<uint16_t>(origin);
+                section.originLabel = toQString(label);
+                sectionStart = lineStart;
+            }
+        }
+
+        lineStart = lineEnd + 1;
+        lineNumber++;
+    }
+    sections.back().text = source.substr(sectionStart);
+    return true;
+}
+
+void assembleSection(AsmSection &section)
+{
+    uint16_t address = section.origin;
+    QVector<QPair<QString, AsmFixup>> pending;
+
+    AsmLexer lexer(section.text, section.firstLine);
+    AsmLine line;
+    while (lexer.nextLine(line))
+    {
+        AsmTokens tokens = line.statement;
+        const Lc3InstructionDesc *desc = tokens.empty() ? nullptr : lc3FindMnemonic(tokens[0].text);
+        if (desc && desc->kind == Lc3EntryKind::Org)
+            continue; // The section's own ORG line; its label is placed at link time
+        if (desc && desc->kind == Lc3EntryKind::End)
+            tokens = {};
+        if (desc && (desc->kind == Lc3EntryKind::Export || desc->kind == Lc3EntryKind::Import))
+        {
+            auto &names = desc->kind == Lc3EntryKind::Export ? section.exports : section.imports;
+            if (tokens.size() == 2 && tokens[1].kind == AsmTokenKind::Word)
+                names.append({toQString(tokens[1].text), static_cast<int>(line.number)});
+            else
+                section.errors.append({static_cast<int>(line.number), QString("%1 takes one label on line %2").arg(toQString(tokens[0].text)).arg(line.number)});
+            tokens = {};
+        }
+
+        if (line.label)
+        {
+            section.labels.insert(line.label->text, address); // Duplicates are reported by the link step
+            section.definitions.append({toQString(line.label->text), static_cast<int>(line.number)});
+        }
+        if (tokens.empty())
+            continue;
+
+        if (desc && desc->kind == Lc3EntryKind::Block)
+        {
+            AsmBlock block;
+            QString error;
+            bool ok = expandBlockDirective(tokens, block, error);
+            if (!ok)
+                section.errors.append({static_cast<int>(line.number), QString("%1 on line %2: %3").arg(error).arg(line.number).arg(toQString(line.text))});
+            else if (!block.fitsAt(address))
+            {
+                section.errors.append({static_cast<int>(line.number), QString("Block on line %1 runs past xFFFF").arg(line.number)});
+                ok = false;
+            }
+            if (block.words.empty())
+                section.words.insert(section.words.end(), block.size, block.fill);
+            else
+                section.words.insert(section.words.end(), block.words.begin(), block.words.end());
+            section.emitted.insert(section.emitted.end(), block.size, ok);
+            if (ok)
+                section.spans.push_back({address, block.size, line.number});
+            address += block.size;
+            continue;
+        }
+
+        uint16_t word = 0;
+        QString target, error;
+        uint8_t targetWidth = 0;
+        bool ok = assembleDeferred(tokens, word, target, targetWidth, error);
+        if (!ok)
+            section.errors.append({static_cast<int>(line.number), QString("%1 on line %2: %3").arg(error).arg(line.number).arg(toQString(line.text))});
+        else if (!target.isEmpty())
+            pending.append({target, AsmFixup{address, targetWidth, static_cast<int>(line.number)}});
+
+        section.words.push_back(word);
+        section.emitted.push_back(ok);
+        if (ok)
+            section.spans.push_back({address, 1, line.number});
+        address++; // A rejected statement still takes its slot so later labels stay put
+    }
+
+    // References to this section's own labels are resolved here, in parallel
+    for (const auto &[label, fixup] : std::as_const(pending))
+    {
+        if (!section.labels.contains(label))
+        {
+            section.external.append({label, fixup});
+            continue;
+        }
+        uint16_t packed;
+        int offset = static_cast<int16_t>(section.labels.value(label) - fixup.address - 1);
+        if (lc3SignedField(offset, fixup.width, packed))
+            section.words[static_cast<uint16_t>(fixup.address - section.origin)] |= packed;
+        else
+            section.errors.append({fixup.line, QString("PC offset to %1 out of range on line %2").arg(label).arg(fixup.line)});
+    }
+}
+
+uint32_t linkSections(std::vector<AsmSection> &sections, AsmSymbolTable &labels, LC3Memory &memory)
+{
+    AsmDiagnostics errors;
+    auto define = [&](const QString &name, uint16_t address, int line) {
+        if (labels.contains(name))
+            errors.append({line, QString("Label %1 redefined on line %2").arg(name).arg(line)});
+        labels.insert(name, address);
+    };
+
+    // Combined symbol table, in source order
+    uint16_t previousEnd = 0x3000;
+    for (const AsmSection &section : sections)
+    {
+        if (!section.originLabel.isEmpty())
+            define(section.originLabel, previousEnd, static_cast<int>(section.firstLine));
+        for (const auto &[name, line] : section.definitions)
+            define(name, section.labels.value(name), line);
+        previousEnd = static_cast<uint16_t>(section.origin + section.words.size());
+    }
+
+    // Cross-section references, then the words themselves
+    std::bitset<LC3Memory::Size> written;
+    uint32_t endAddress = 0x3000;
+    for (AsmSection &section : sections)
+    {
+        for (const auto &[label, fixup] : std::as_const(section.external))
+        {
+            uint16_t packed;
+            if (!labels.contains(label))
+                errors.append({fixup.line, QString("Undefined label %1 on line %2").arg(label).arg(fixup.line)});
+            else if (!lc3SignedField(static_cast<int16_t>(labels.value(label) - fixup.address - 1), fixup.width, packed))
+                errors.append({fixup.line, QString("PC offset to %1 out of range on line %2").arg(label).arg(fixup.line)});
+            else
+                section.words[static_cast<uint16_t>(fixup.address - section.origin)] |= packed;
+        }
+
+        bool overlapReported = false;
+        for (std::size_t i = 0; i < section.words.size(); ++i)
+        {
+            if (!section.emitted[i])
+                continue;
+            uint16_t address = static_cast<uint16_t>(section.origin + i);
+            if (written.test(address) && !overlapReported)
+            {
+                errors.append({static_cast<int>(section.firstLine),
+                               QString("Section at line %1 overlaps earlier code at x%2").arg(section.firstLine).arg(QString("%1").arg(address, 4, 16, QChar('0')).toUpper())});
+                overlapReported = true; // Once per section; later sections still win, as in a serial build
+            }
+            written.set(address);
+            memory.write(address, section.words[i]);
+            endAddress = std::max<uint32_t>(endAddress, address + 1u);
+        }
+        for (const AsmSourceSpan &span : section.spans)
+            recordSourceLine(span.address, span.size, span.line);
+        errors.append(section.errors);
+    }
+
+    std::stable_sort(errors.begin(), errors.end(), [](const AsmDiagnostic &a, const AsmDiagnostic &b) { return a.line < b.line; });
+    for (const auto &error : std::as_const(errors))
+        reportAssemblyError(error.line, error.message);
+    return endAddress;
+}
+
+uint32_t assembleParallel(std::string_view source, AsmSymbolTable &labels, LC3Memory &memory)
+{
+    // Splitting and linking cost about half a serial pass, so one core is better
+    // served by the single-pass assembler
+    std::vector<AsmSection> sections;
+    if (QThreadPool::globalInstance()->maxThreadCount() < 2 || !splitSections(source, sections) || sections.size() < 2)
+        return assembleSinglePass(source, labels, memory);
+
+    AsmIncbinFiles *files = AsmIncbinScope::current(); // The pool threads read through the same set
+    QtConcurrent::blockingMap(sections, [files](AsmSection &section) {
+        AsmIncbinScope incbin(files);
+        assembleSection(section);
+    });
+    return linkSections(sections, labels, memory);
+}
+
+uint32_t assembleExpanded(std::string_view text, const AsmPreprocessed &expanded, const QString &directory,
+                          AsmSymbolTable &labels, LC3Memory &memory, AsmSourceMap &sourceMap, AsmDiagnostics &diagnostics)
+{
+    qsizetype first = diagnostics.size();
+    uint32_t endAddress = 0;
+    {
+        AsmDiagnosticCollector collect(diagnostics);
+        AsmSourceMapRecorder record(sourceMap);
+        AsmIncbinFiles files(directory);
+        AsmIncbinScope incbin(&files);
+        endAddress = assembleParallel(text, labels, memory);
+    }
+    sourceMap.finish(expanded.origins);
+    mapDiagnosticsToSource(diagnostics, first, expanded);
+    return endAddress;
+}
@@ -0,0 +1,61 @@
+#ifndef ASMSECTIONS_H
+#define ASMSECTIONS_H
+
+#include "AssemblerLogic.h"
+#include <QPair>
+#include <QString>
+#include <QVector>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// One ORG-delimited piece of a program. Because ORG takes an absolute address,
+// a section can be assembled without knowing anything about the others. Labels
+// it defines resolve locally, and references to labels it does not define are
+// left for the link step.
+struct AsmSection
+{
+    // Input, filled in by splitSections()
+    std::string_view text; // From the ORG line (if any) up to the next ORG or END
+    uint32_t firstLine = 1;
+    uint16_t origin = 0x3000;
+    QString originLabel;   // "LABEL, ORG x4000": the label takes the previous section's end address
+
+    // Output, filled in by assembleSection()
+    std::vector<uint16_t> words;   // One per statement from origin on
+    std::vector<uint8_t> emitted;  // 0 where a statement was rejected and wrote nothing
+    AsmSymbolTable labels;
+    QVector<QPair<QString, int>> definitions; // Label and line, in source order
+    QVector<QPair<QString, AsmFixup>> external;
+    QVector<QPair<QString, int>> exports;     // EXPORT/IMPORT label and line; only used when linking modules
+    QVector<QPair<QString, int>> imports;
+    AsmDiagnostics errors;
+    std::vector<AsmSourceSpan> spans;         // Statements that emitted words, for the source map
+    bool ended = false;                       // Contains the END directive
+};
+
+// Cuts the source at ORG lines with a cheap scan of each line's first words; the
+// statements themselves are not lexed. Everything after END is dropped. False if
+// an ORG operand is not a valid address; the caller should then assemble serially.
+bool splitSections(std::string_view source, std::vector<AsmSection> &sections);
+
+void assembleSection(AsmSection &section);
+
+// Resolves cross-section references against the combined symbol table, reports
+// duplicate labels and sections that write the same address, and copies the words
+// into memory. Returns one past the highest address written.
+uint32_t linkSections(std::vector<AsmSection> &sections, AsmSymbolTable &labels, LC3Memory &memory);
+
+// Splits, assembles the sections concurrently on the global thread pool, and links.
+// Falls back to assembleSinglePass() for sources with a single section or a
+// single-threaded pool.
+uint32_t assembleParallel(std::string_view source, AsmSymbolTable &labels, LC3Memory &memory);
+
+// One build of text, the result of expandAssembly(), as every front end runs it:
+// assembleParallel() with .INCBIN resolved against directory, the source map
+// recorded and finished through expanded's origins, and the diagnostics appended
+// to diagnostics mapped back to the files and lines they came from.
+uint32_t assembleExpanded(std::string_view text, const AsmPreprocessed &expanded, const QString &directory,
+                          AsmSymbolTable &labels, LC3Memory &memory, AsmSourceMap &sourceMap, AsmDiagnostics &diagnostics);
+
+#endif // ASMSECTIONS_H
@@ -0,0 +1,154 @@
+#include "asmsourcemap.h"
+#include <QHash>
+#include <algorithm>
+#include <numeric>
+#include <tuple>
+
+static thread_local AsmSourceMap *currentMap = nullptr;
+
+AsmSourceMapRecorder::AsmSourceMapRecorder(AsmSourceMap &map)
+    : previous(currentMap)
+{
+    currentMap = &map;
+}
+
+AsmSourceMapRecorder::~AsmSourceMapRecorder()
+{
+    currentMap = previous;
+}
+
+void recordSourceLine(uint16_t address, uint32_t size, uint32_t line)
+{
+    if (currentMap && size > 0)
+        currentMap->add({address, size, line});
+}
+
+void AsmSourceMap::add(const AsmSourceSpan &span)
+{
+    spans.push_back({span.address, 0, span.line, span.size});
+}
+
+void AsmSourceMap::finish(const std::vector<AsmOrigin> &origins)
+{
+    if (!origins.empty())
+    {
+        QHash<QString, uint16_t> ids;
+        for (qsizetype i = 0; i < files.size(); ++i)
+            ids.insert(files[i], static_cast<uint16_t>(i));
+        for (Entry &entry : spans)
+        {
+            if (entry.line == 0 || entry.line > origins.size())
+                continue;
+            const AsmOrigin &origin = origins[entry.line - 1];
+            if (!ids.contains(origin.file))
+            {
+                ids.insert(origin.file, static_cast<uint16_t>(files.size()));
+                files.append(origin.file);
+            }
+            entry.file = ids.value(origin.file);
+            entry.line = origin.line;
+        }
+    }
+
+    // Spans were added in the order the words were written
+    std::stable_sort(spans.begin(), spans.end(), [](const Entry &a, const Entry &b) { return a.address < b.address; });
+    std::vector<Entry> kept;
+    kept.reserve(spans.size());
+    for (const Entry &entry : spans)
+    {
+        if (!kept.empty() && kept.back().address == entry.address)
+            kept.back() = entry;
+        else
+            kept.push_back(entry);
+    }
+    spans = std::move(kept);
+    index();
+}
+
+void AsmSourceMap::index()
+{
+    byLine.resize(spans.size());
+    std::iota(byLine.begin(), byLine.end(), 0u);
+    std::sort(byLine.begin(), byLine.end(), [this](uint32_t a, uint32_t b) {
+        return std::tie(spans[a].file, spans[a].line, spans[a].address) < std::tie(spans[b].file, spans[b].line, spans[b].address);
+    });
+}
+
+void AsmSourceMap::clear()
+{
+    files = QStringList{QString()};
+    spans.clear();
+    byLine.clear();
+}
+
+bool AsmSourceMap::lookup(uint16_t address, QString &file, uint32_t &line) const
+{
+    auto it = std::upper_bound(spans.begin(), spans.end(), address, [](uint16_t value, const Entry &entry) { return value < entry.address; });
+    if (it == spans.begin())
+        return false;
+    --it;
+    if (static_cast<uint32_t>(address - it->address) >= it->size)
+        return false;
+    file = files[it->file];
+    line = it->line;
+    return true;
+}
+
+bool AsmSourceMap::address(const QString &file, uint32_t line, uint16_t &address) const
+{
+    qsizetype id = files.indexOf(file);
+    if (id < 0)
+        return false;
+    auto key = std::make_pair(static_cast<uint16_t>(id), line);
+    auto it = std::lower_bound(byLine.begin(), byLine.end(), key, [this](uint32_t index, const std::pair<uint16_t, uint32_t> &value) {
+        return std::make_pair(spans[index].file, spans[index].line) < value;
+    });
+    if (it == byLine.end() || spans[*it].file != key.first || spans[*it].line != line)
+        return false;
+    address = spans[*it].address;
+    return true;
+}
+
+bool AsmSourceMap::entryPoint(uint16_t &address) const
+{
+    if (byLine.empty())
+        return false;
+    address = spans[byLine.front()].address; // The main source is file 0, so it sorts first
+    return true;
+}
+
+QDataStream &operator<<(QDataStream &out, const AsmSourceMap &map)
+{
+    out << map.files << quint32(map.spans.size());
+    for (const AsmSourceMap::Entry &entry : map.spans)
+        out << quint16(entry.address) << quint16(entry.file) << quint32(entry.line) << quint32(entry.size);
+    return out;
+}
+
+QDataStream &operator>>(QDataStream &in, AsmSourceMap &map)
+{
+    quint32 count = 0;
+    map.clear();
+    in >> map.files >> count;
+    if (map.files.isEmpty() || count > 0x10000)
+    {
+        map.clear();
+        in.setStatus(QDataStream::ReadCorruptData);
+        return in;
+    }
+    map.spans.resize(count);
+    for (AsmSourceMap::Entry &entry : map.spans)
+    {
+        quint16 address = 0, file = 0;
+        quint32 line = 0, size = 0;
+        in >> address >> file >> line >> size;
+        if (file >= map.files.size())
+            in.setStatus(QDataStream::ReadCorruptData);
+        entry = {address, file, line, size};
+    }
+    if (in.status() != QDataStream::Ok)
+        map.clear();
+    else
+        map.index();
+    return in;
+}
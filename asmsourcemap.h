@@ -0,0 +1,79 @@
+#ifndef ASMSOURCEMAP_H
+#define ASMSOURCEMAP_H
+
+#include "asmpreprocessor.h"
+#include <QDataStream>
+#include <QString>
+#include <QStringList>
+#include <cstdint>
+#include <vector>
+
+// The words one statement wrote
+struct AsmSourceSpan
+{
+    uint16_t address = 0;
+    uint32_t size = 1;
+    uint32_t line = 0; // In the text that was assembled
+};
+
+// Which source line wrote each address, and which address each line wrote. Both
+// directions are sorted tables searched in O(log n), 12 bytes per statement.
+class AsmSourceMap
+{
+public:
+    void add(const AsmSourceSpan &span);
+
+    // Sorts the spans and turns lines of preprocessed text into (file, line)
+    // through origins. Call once, after assembling; an empty origins means the
+    // text was the main source itself. Where spans overlap the later one wins,
+    // as it did in memory.
+    void finish(const std::vector<AsmOrigin> &origins = {});
+
+    void clear();
+    bool isEmpty() const { return spans.empty(); }
+
+    // The statement that wrote address. file is empty for the main source.
+    bool lookup(uint16_t address, QString &file, uint32_t &line) const;
+    // The first address the statement on line wrote
+    bool address(const QString &file, uint32_t line, uint16_t &address) const;
+    // Where the program starts: the address the first statement of the main
+    // source wrote (of an include file, if the main source wrote nothing)
+    bool entryPoint(uint16_t &address) const;
+
+    friend QDataStream &operator<<(QDataStream &out, const AsmSourceMap &map);
+    friend QDataStream &operator>>(QDataStream &in, AsmSourceMap &map);
+
+private:
+    struct Entry
+    {
+        uint16_t address;
+        uint16_t file; // Index into files
+        uint32_t line;
+        uint32_t size;
+    };
+
+    void index();
+
+    QStringList files{QString()};  // files[0] is the main source
+    std::vector<Entry> spans;      // By address once finished
+    std::vector<uint32_t> byLine;  // Indexes into spans, by file and line
+};
+
+// Adds every statement assembled on this thread to map while it is alive.
+// Recorders nest like AsmDiagnosticCollector.
+class AsmSourceMapRecorder
+{
+public:
+    explicit AsmSourceMapRecorder(AsmSourceMap &map);
+    ~AsmSourceMapRecorder();
+    AsmSourceMapRecorder(const AsmSourceMapRecorder &) = delete;
+    AsmSourceMapRecorder &operator=(const AsmSourceMapRecorder &) = delete;
+
+private:
+    AsmSourceMap *previous;
+};
+
+// Called by the assembler for each statement it writes; nothing without a recorder
+void recordSourceLine(uint16_t address, uint32_t size, uint32_t line);
+
+#endif // ASMSOURCEMAP_H
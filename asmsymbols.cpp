@@ -0,0 +1,161 @@
+#include "asmsymbols.h"
+#include <QByteArray>
+#include <algorithm>
+#include <numeric>
+
+static std::string_view utf8View(const QByteArray &bytes)
+{
+    return std::string_view(bytes.constData(), static_cast<std::size_t>(bytes.size()));
+}
+
+AsmSymbolTable::AsmSymbolTable(const AsmSymbolTable &other)
+{
+    insert(other);
+}
+
+AsmSymbolTable &AsmSymbolTable::operator=(const AsmSymbolTable &other)
+{
+    if (this != &other)
+    {
+        clear();
+        insert(other);
+    }
+    return *this;
+}
+
+// The names stay in the moved arena, so the views in symbols and index stay valid
+AsmSymbolTable::AsmSymbolTable(AsmSymbolTable &&other) noexcept
+    : names(std::move(other.names)), symbols(std::move(other.symbols)), index(std::move(other.index)),
+      byAddress(std::move(other.byAddress)), reverseStale(other.reverseStale)
+{
+    other.clear();
+}
+
+AsmSymbolTable &AsmSymbolTable::operator=(AsmSymbolTable &&other) noexcept
+{
+    if (this != &other)
+    {
+        names = std::move(other.names);
+        symbols = std::move(other.symbols);
+        index = std::move(other.index);
+        byAddress = std::move(other.byAddress);
+        reverseStale = other.reverseStale;
+        other.clear();
+    }
+    return *this;
+}
+
+void AsmSymbolTable::insert(std::string_view name, uint16_t address)
+{
+    reverseStale = true;
+    auto it = index.find(name);
+    if (it != index.end())
+    {
+        symbols[it->second].address = address;
+        return;
+    }
+    if (!names)
+        names = std::make_unique<AsmArena>(4096);
+    std::string_view interned = names->store(name);
+    index.emplace(interned, static_cast<uint32_t>(symbols.size()));
+    symbols.push_back({interned, address});
+}
+
+void AsmSymbolTable::insert(const QString &name, uint16_t address)
+{
+    QByteArray utf8 = name.toUtf8();
+    insert(utf8View(utf8), address);
+}
+
+void AsmSymbolTable::insert(const AsmSymbolTable &other)
+{
+    index.reserve(index.size() + other.symbols.size());
+    for (const AsmSymbol &symbol : other.symbols)
+        insert(symbol.name, symbol.address);
+}
+
+const uint16_t *AsmSymbolTable::find(std::string_view name) const
+{
+    auto it = index.find(name);
+    return it == index.end() ? nullptr : &symbols[it->second].address;
+}
+
+bool AsmSymbolTable::contains(const QString &name) const
+{
+    QByteArray utf8 = name.toUtf8();
+    return contains(utf8View(utf8));
+}
+
+uint16_t AsmSymbolTable::value(std::string_view name, uint16_t fallback) const
+{
+    const uint16_t *address = find(name);
+    return address ? *address : fallback;
+}
+
+uint16_t AsmSymbolTable::value(const QString &name, uint16_t fallback) const
+{
+    QByteArray utf8 = name.toUtf8();
+    return value(utf8View(utf8), fallback);
+}
+
+void AsmSymbolTable::clear()
+{
+    index.clear();
+    symbols.clear();
+    byAddress.clear();
+    names.reset();
+    reverseStale = false;
+}
+
+void AsmSymbolTable::buildReverseIndex() const
+{
+    byAddress.resize(symbols.size());
+    std::iota(byAddress.begin(), byAddress.end(), 0u);
+    std::stable_sort(byAddress.begin(), byAddress.end(), [this](uint32_t a, uint32_t b) { return symbols[a].address < symbols[b].address; });
+    reverseStale = false;
+}
+
+const AsmSymbol *AsmSymbolTable::symbolAt(uint16_t address) const
+{
+    const AsmSymbol *nearest = nearestSymbol(address);
+    return nearest && nearest->address == address ? nearest : nullptr;
+}
+
+const AsmSymbol *AsmSymbolTable::nearestSymbol(uint16_t address) const
+{
+    if (reverseStale)
+        buildReverseIndex();
+    // First of the highest address not above the one asked for
+    auto it = std::upper_bound(byAddress.begin(), byAddress.end(), address,
+                               [this](uint16_t value, uint32_t i) { return value < symbols[i].address; });
+    if (it == byAddress.begin())
+        return nullptr;
+    uint16_t found = symbols[*std::prev(it)].address;
+    it = std::lower_bound(byAddress.begin(), it, found, [this](uint32_t i, uint16_t value) { return symbols[i].address < value; });
+    return &symbols[*it];
+}
+
+QDataStream &operator<<(QDataStream &out, const AsmSymbolTable &table)
+{
+    out << quint32(table.symbols.size());
+    for (const AsmSymbol &symbol : table.symbols)
+        out << QString::fromUtf8(symbol.name.data(), static_cast<int>(symbol.name.size())) << quint16(symbol.address);
+    return out;
+}
+
+QDataStream &operator>>(QDataStream &in, AsmSymbolTable &table)
+{
+    quint32 count = 0;
+    in >> count;
+    AsmSymbolTable read;
+    for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; ++i)
+    {
+        QString name;
+        quint16 address = 0;
+        in >> name >> address;
+        read.insert(name, address);
+    }
+    if (in.status() == QDataStream::Ok)
+        table = std::move(read);
+    return in;
+}
@@ -0,0 +1,75 @@
+#ifndef ASMSYMBOLS_H
+#define ASMSYMBOLS_H
+
+#include "asmlexer.h"
+#include <QDataStream>
+#include <QString>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+struct AsmSymbol
+{
+    std::string_view name; // Interned in the table; valid while the table is
+    uint16_t address = 0;
+};
+
+// The assembler's label table. Each name is copied once into an arena and found
+// by hash straight from the token text, so resolving an operand costs one hash
+// and no allocation however many labels there are. Iteration follows definition
+// order.
+// The reverse index (address to labels) is built by the first reverse lookup
+// after a change, so reverse lookups must not race with each other.
+class AsmSymbolTable
+{
+public:
+    AsmSymbolTable() = default;
+    AsmSymbolTable(const AsmSymbolTable &other);
+    AsmSymbolTable &operator=(const AsmSymbolTable &other);
+    AsmSymbolTable(AsmSymbolTable &&other) noexcept;
+    AsmSymbolTable &operator=(AsmSymbolTable &&other) noexcept;
+
+    // Defines name at address. A name defined again keeps its place in the
+    // iteration order and takes the new address.
+    void insert(std::string_view name, uint16_t address);
+    void insert(const QString &name, uint16_t address);
+    void insert(const char *name, uint16_t address) { insert(std::string_view(name), address); }
+    void insert(const AsmSymbolTable &other);
+
+    const uint16_t *find(std::string_view name) const; // Null if undefined
+    bool contains(std::string_view name) const { return find(name) != nullptr; }
+    bool contains(const QString &name) const;
+    bool contains(const char *name) const { return contains(std::string_view(name)); }
+    uint16_t value(std::string_view name, uint16_t fallback = 0) const;
+    uint16_t value(const QString &name, uint16_t fallback = 0) const;
+    uint16_t value(const char *name, uint16_t fallback = 0) const { return value(std::string_view(name), fallback); }
+
+    qsizetype size() const { return static_cast<qsizetype>(symbols.size()); }
+    bool isEmpty() const { return symbols.empty(); }
+    void clear();
+
+    std::vector<AsmSymbol>::const_iterator begin() const { return symbols.begin(); }
+    std::vector<AsmSymbol>::const_iterator end() const { return symbols.end(); }
+
+    // For disassemblers, profilers and traces, in O(log n): the first label
+    // defined at address, and the label at or nearest below it (for "LOOP+3").
+    // Null if there is none.
+    const AsmSymbol *symbolAt(uint16_t address) const;
+    const AsmSymbol *nearestSymbol(uint16_t address) const;
+
+    friend QDataStream &operator<<(QDataStream &out, const AsmSymbolTable &table);
+    friend QDataStream &operator>>(QDataStream &in, AsmSymbolTable &table);
+
+private:
+    void buildReverseIndex() const;
+
+    std::unique_ptr<AsmArena> names;                       // Created with the first symbol
+    std::vector<AsmSymbol> symbols;
+    std::unordered_map<std::string_view, uint32_t> index;  // Into symbols
+    mutable std::vector<uint32_t> byAddress;               // Into symbols, by address then definition
+    mutable bool reverseStale = false;
+};
+
+#endif // ASMSYMBOLS_H
@@ -1,28 +1,243 @@
 #include "assembler.h"
-#include"AssemblerLogic.cpp"
+#include "AssemblerLogic.h"
+#include "asmpeephole.h"
+#include "asmpreprocessor.h"
+#include "asmsections.h"
+#include "lc3imagecache.h"
+#include "lc3object.h"
+#include "lc3programfile.h"
+#include <QFileInfo>
+#include <QMessageBox>
+#include <QStandardPaths>
+#include <algorithm>
 
-// Define globalFile as an instance of binFile class, assuming it's declared properly elsewhere
-FileReadWrite BinFile("MEMORY.bin");
+const QString ProgramFileName = "MEMORY.lc3";
+AsmSourceMap assembledSourceMap;
 
+// The build caches last for the session and are created on first use
+static AsmIncludeCache &includeCache() {
+    static AsmIncludeCache cache;
+    return cache;
+}
+
+static LC3ImageCache &imageCache() {
+    static LC3ImageCache cache(QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/images");
+    return cache;
+}
 
+static LC3ObjectCache &objectCache() {
+    static LC3ObjectCache cache(QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/objects");
+    return cache;
+}
+
+AssemblyCacheStats assemblyCacheStats() {
+    AssemblyCacheStats stats;
+    stats.imageHits = imageCache().hits();
+    stats.imageMisses = imageCache().misses();
+    stats.objectHits = objectCache().hits();
+    stats.objectMisses = objectCache().misses();
+    // Module builds keep their own include cache inside the object cache
+    stats.includeHits = includeCache().hits() + objectCache().includeCache().hits();
+    stats.includeMisses = includeCache().misses() + objectCache().includeCache().misses();
+    return stats;
+}
+
+// Shows every problem from one build in a single non-modal box, however many
+// there are; the assembler itself only collects them
+static void showDiagnostics(const AsmDiagnostics &diagnostics) {
+    if (diagnostics.isEmpty())
+        return;
+
+    QStringList messages;
+    for (const AsmDiagnostic &diagnostic : diagnostics)
+        messages.append(diagnostic.message);
+    auto *box = new QMessageBox(QMessageBox::Critical, "Assembly Errors",
+                                QString("%1 problem(s) found. The first: %2").arg(messages.size()).arg(messages.first()));
+    box->setDetailedText(messages.join("\n"));
+    box->setAttribute(Qt::WA_DeleteOnClose);
+    box->show();
+}
+
+// Writes every segment of an assembled image, its symbols and its source map to
+// MEMORY.lc3. The program starts at the first statement of the source; module
+// builds have no source map and start at their lowest address.
+int writeAssembly(const LC3Memory &image, const AsmSymbolTable &labels, const AsmSourceMap &sourceMap) {
+    uint16_t entry = 0x3000;
+    if (!sourceMap.entryPoint(entry)) {
+        std::vector<LC3MemoryRange> used = LC3ProgramFile::usedRanges(image);
+        if (!used.empty())
+            entry = used.front().start;
+    }
 
-int startAssembly(QString &assemblyCode) {
-    // Convert assembly code from QString to QVector<QString> for compatibility with existing functions
-    QVector<QString> codeLines = assemblyCode.split("\n", Qt::SkipEmptyParts).toVector();
+    LC3ProgramFile program(ProgramFileName);
+    if (!program.save(image, entry, labels, sourceMap)) {
+        QMessageBox::critical(nullptr, "Error", program.errorString());
+        return 1;
+    }
+    assembledSourceMap = sourceMap;
+
+    QMessageBox::information(nullptr, "Assembly Completed", "Assembly completed. Output written to " + ProgramFileName);
+
+    return 0;
+}
+
+// Expands .INCLUDE and .MACRO. Include files stay lexed across builds until they
+// change on disk.
+static std::string_view preprocess(std::string_view source, const QString &directory, AsmPreprocessed &expanded) {
+    return expandAssembly(source, directory, includeCache(), expanded);
+}
+
+// Assembles a whole source, or takes the image from the cache when the same text
+// was assembled cleanly before. The key is taken after preprocessing, so editing
+// an include file is a miss.
+static int assembleCached(std::string_view source, const QString &directory) {
+    LC3ImageCache &cache = imageCache();
+
+    AsmDiagnostics diagnostics;
+    AsmPreprocessed expanded;
+    {
+        AsmDiagnosticCollector collect(diagnostics);
+        source = preprocess(source, directory, expanded);
+    }
 
-    if (codeLines.isEmpty()) {
+    QByteArray key = LC3ImageCache::key(source, expanded.origins);
+    AsmSymbolTable labels;
+    LC3Memory tempMemory(LC3Memory::Layout::Paged); // Only the pages the program touches are allocated
+    uint32_t endAddress = 0x3000;
+    AsmSourceMap sourceMap;
+    if (!cache.lookup(key, tempMemory, endAddress, labels, sourceMap)) {
+        int reads = assemblyFileReads();
+        endAddress = assembleExpanded(source, expanded, directory, labels, tempMemory, sourceMap, diagnostics);
+        if (diagnostics.isEmpty() && assemblyFileReads() == reads) // .INCBIN data is not in the key
+            cache.store(key, tempMemory, endAddress, labels, sourceMap);
+    }
+    showDiagnostics(diagnostics);
+    return writeAssembly(tempMemory, labels, sourceMap);
+}
+
+int startAssembly(const QString &code, bool optimize, const QString &directory) {
+    if (code.trimmed().isEmpty()) {
         QMessageBox::warning(nullptr, "No Code Provided", "No code provided for assembly. Exiting...");
         return 1; // Return error code
     }
 
-    QMap<QString, uint16_t> labels = processLabels(codeLines);
-    LC3Memory tempMemory(0xFFFF); // Create memory with size 0xFFFF (64KB)
-    assembleInstructionSetA(codeLines, labels, tempMemory);
+    // The lexer works directly on the UTF-8 bytes; tokens are views into this buffer
+    QByteArray source = code.toUtf8();
+    if (!optimize)
+        return assembleCached(std::string_view(source.constData(), source.size()), directory);
 
-    // Assuming globalFile is an instance of a custom class that handles file operations
-    BinFile.writeToFile(tempMemory, 0x3000, 0x3000 + codeLines.size() - 1);
+    // Not cached, so the report is shown on every build
+    QStringList report;
+    AsmSymbolTable labels;
+    LC3Memory tempMemory(LC3Memory::Layout::Paged);
+    AsmDiagnostics diagnostics;
+    AsmPreprocessed expanded;
+    AsmSourceMap sourceMap;
+    {
+        AsmDiagnosticCollector collect(diagnostics);
+        std::string_view text = preprocess(std::string_view(source.constData(), source.size()), directory, expanded);
+        qsizetype first = diagnostics.size();
+        AsmSourceMapRecorder record(sourceMap); // The optimizer keeps every line where it was
+        AsmIncbinFiles files(directory);
+        AsmIncbinScope incbin(&files);
+        assembleOptimized(text, labels, tempMemory, report);
+        mapDiagnosticsToSource(diagnostics, first, expanded);
+    }
+    sourceMap.finish(expanded.origins);
+    showDiagnostics(diagnostics);
+    if (!report.isEmpty())
+        QMessageBox::information(nullptr, "Optimizer", report.join("\n"));
+    return writeAssembly(tempMemory, labels, sourceMap);
+}
 
-    QMessageBox::information(nullptr, "Assembly Completed", "Assembly completed. Output written to MEMORY.bin");
+// Assembles straight from a file without ever holding the whole source in a
+// QString. The file is memory-mapped when possible, so the kernel pages the text
+// in and out as the lexer walks it; otherwise it is streamed in chunks cut at line
+// boundaries. Either way memory use is bounded by the symbol table and the image.
+int startAssemblyFile(const QString &fileName) {
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        QMessageBox::warning(nullptr, "Error", "Failed to open file for reading: " + file.errorString());
+        return 1;
+    }
+    if (file.size() == 0) {
+        QMessageBox::warning(nullptr, "No Code Provided", "No code provided for assembly. Exiting...");
+        return 1;
+    }
 
-    return 0;
+    if (uchar *mapping = file.map(0, file.size())) {
+        int result = assembleCached(std::string_view(reinterpret_cast<const char *>(mapping), static_cast<std::size_t>(file.size())),
+                                    QFileInfo(fileName).absolutePath());
+        file.unmap(mapping);
+        return result;
+    }
+
+    // Not mappable (a pipe, or some network filesystems): read fixed-size chunks and
+    // carry any partial last line over to the next one. Streamed sources are not
+    // cached or preprocessed: both need the whole text before assembly could start.
+    constexpr qint64 ChunkSize = 1 << 20;
+    AsmSymbolTable labels;
+    LC3Memory tempMemory(LC3Memory::Layout::Paged);
+    AsmPassState state;
+    QByteArray buffer;
+    uint32_t firstLine = 1;
+    AsmDiagnostics diagnostics;
+    AsmDiagnosticCollector collect(diagnostics);
+    AsmSourceMap sourceMap;
+    AsmSourceMapRecorder record(sourceMap);
+    AsmIncbinFiles files(QFileInfo(fileName).absolutePath());
+    AsmIncbinScope incbin(&files);
+    bool more = true;
+    while (more) {
+        qsizetype carried = buffer.size();
+        buffer.resize(carried + ChunkSize);
+        qint64 got = file.read(buffer.data() + carried, ChunkSize);
+        more = got > 0;
+        buffer.resize(carried + std::max<qint64>(got, 0));
+
+        // At end of file the last line needs no newline
+        qsizetype cut = more ? buffer.lastIndexOf('\n') + 1 : buffer.size();
+        if (cut == 0)
+            continue; // One line longer than the buffer so far
+        std::string_view chunk(buffer.constData(), static_cast<std::size_t>(cut));
+        if (!assembleChunk(chunk, firstLine, labels, tempMemory, state))
+            break;
+        firstLine += static_cast<uint32_t>(std::count(chunk.begin(), chunk.end(), '\n'));
+        buffer.remove(0, cut);
+    }
+
+    finishSinglePass(state);
+    sourceMap.finish();
+    showDiagnostics(diagnostics);
+    return writeAssembly(tempMemory, labels, sourceMap);
+}
+
+// Builds a program from several modules. Each module is assembled to a relocatable
+// object, or loaded from the object cache if its source has not changed since the
+// last build, and the objects are linked in the order given.
+int startAssemblyModules(const QStringList &fileNames) {
+    LC3ObjectCache &cache = objectCache();
+
+    AsmDiagnostics diagnostics;
+    std::vector<LC3Object> objects(fileNames.size());
+    for (qsizetype i = 0; i < fileNames.size(); ++i) {
+        if (!cache.build(fileNames[i], objects[i])) {
+            QMessageBox::warning(nullptr, "Error", "Failed to open file for reading: " + fileNames[i]);
+            return 1;
+        }
+        for (const auto &[line, message] : std::as_const(objects[i].errors))
+            diagnostics.append({line, fileNames[i] + ": " + message});
+    }
+
+    std::vector<const LC3Object *> inputs;
+    for (const LC3Object &object : objects)
+        inputs.push_back(&object);
+    AsmSymbolTable labels;
+    LC3Memory tempMemory(LC3Memory::Layout::Paged);
+    {
+        AsmDiagnosticCollector collect(diagnostics);
+        linkObjects(inputs, labels, tempMemory);
+    }
+    showDiagnostics(diagnostics);
+    return writeAssembly(tempMemory, labels); // Objects carry no line table, so no source map
 }
@@ -2,19 +2,30 @@
 #define ASSEMBLER_H
 
 #include <QString>
+#include <QStringList>
 #include "lc3memory.h"
-#include "FileReadWrite.h"
-#include <QCoreApplication>
-#include <QRegularExpression>
+#include "asmsourcemap.h"
+#include "asmsymbols.h"
 
+extern const QString ProgramFileName;   // MEMORY.lc3, the program the last build wrote
+extern AsmSourceMap assembledSourceMap; // Of the program in ProgramFileName
 
-extern FileReadWrite BinFile;
-class Assembler
+int startAssembly(const QString &code, bool optimize = false, const QString &directory = QString());
+int startAssemblyFile(const QString &fileName);
+int startAssemblyModules(const QStringList &fileNames);
+// How often the build caches were used this session, for the status bar
+struct AssemblyCacheStats
 {
-
+    int imageHits = 0;
+    int imageMisses = 0;
+    int objectHits = 0;
+    int objectMisses = 0;
+    int includeHits = 0;
+    int includeMisses = 0;
 };
 
-int startAssembly( QString &inputFilename);
+AssemblyCacheStats assemblyCacheStats();
+int writeAssembly(const LC3Memory &image, const AsmSymbolTable &labels = AsmSymbolTable(), const AsmSourceMap &sourceMap = AsmSourceMap());
 #endif // ASSEMBLER_H
 
 
@@ -0,0 +1,110 @@
+#include "AssemblerLogic.h"
+#include "asmsections.h"
+#include <QElapsedTimer>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <iterator>
+#include <string>
+
+// Assembles a generated source end to end, from text to image, with each
+// assembler and prints source lines per second. The source fills x3000-xEFFF
+// with one ORG section per 4K words, so assembleParallel has sections to split.
+// Every instruction carries a comment, and every 16th line defines a label
+// that later lines branch to and load from.
+//
+// Usage: bench_assembler [runs]   (default 5; the best run is reported)
+
+static std::string generateSource(std::size_t &lines)
+{
+    static const char *const body[] = {
+        "ADD R1, R1, #1 ; count",     "AND R2, R2, #0 ; clear",     "NOT R3, R1 ; invert",
+        "LDR R4, R6, #2 ; frame",     "STR R4, R6, #-3 ; spill",    "ADD R5, R4, R3 ; sum",
+        "LEA R0, L%u ; address",      "BRz L%u ; back to the label", "LD R2, L%u ; reload",
+        "ST R1, L%u ; save",          "JSR L%u ; call",             "ADD R0, R0, #-1 ; step",
+    };
+    constexpr unsigned SectionWords = 0x1000;
+    constexpr unsigned Sections = 12; // x3000-xEFFF
+
+    std::string source;
+    source.reserve(std::size_t(Sections) * SectionWords * 32);
+    lines = 0;
+    char line[64];
+    unsigned label = 0;
+    for (unsigned section = 0; section < Sections; ++section)
+    {
+        std::snprintf(line, sizeof line, "ORG x%X\n", 0x3000 + section * SectionWords);
+        source += line;
+        ++lines;
+        for (unsigned word = 0; word < SectionWords; ++word)
+        {
+            if (word % 16 == 0)
+            {
+                std::snprintf(line, sizeof line, "L%u, ", label++);
+                source += line;
+            }
+            // The label just defined, or for JSR the next one, so single-pass
+            // assembly also has forward references to patch. Both are within
+            // PCoffset9 of the line and in the same section.
+            const char *format = body[word % std::size(body)];
+            bool forward = format[0] == 'J' && word + 16 < SectionWords;
+            std::snprintf(line, sizeof line, format, forward ? label : label - 1);
+            source += line;
+            source += '\n';
+            ++lines;
+        }
+    }
+    source += "END\n";
+    ++lines;
+    return source;
+}
+
+static double bestLinesPerSecond(const char *name, std::size_t lines, int runs, const std::function<void()> &assemble)
+{
+    qint64 best = -1;
+    for (int run = 0; run < runs; ++run)
+    {
+        QElapsedTimer timer;
+        timer.start();
+        assemble();
+        qint64 elapsed = timer.nsecsElapsed();
+        if (best < 0 || elapsed < best)
+            best = elapsed;
+    }
+    double perSecond = double(lines) * 1e9 / double(std::max<qint64>(best, 1));
+    std::printf("%-26s %10.3f ms %14.0f lines/s\n", name, double(best) / 1e6, perSecond);
+    return perSecond;
+}
+
+int main(int argc, char *argv[])
+{
+    int runs = argc > 1 ? std::max(1, std::atoi(argv[1])) : 5;
+    std::size_t lines = 0;
+    std::string source = generateSource(lines);
+    std::printf("%zu lines, %zu bytes, best of %d runs\n", lines, source.size(), runs);
+
+    AsmDiagnostics diagnostics;
+    AsmDiagnosticCollector collect(diagnostics);
+    bestLinesPerSecond("assembleSinglePass", lines, runs, [&] {
+        AsmSymbolTable labels;
+        LC3Memory memory(LC3Memory::Layout::Paged);
+        assembleSinglePass(source, labels, memory);
+    });
+    bestLinesPerSecond("processLabels + SetA", lines, runs, [&] {
+        LC3Memory memory(LC3Memory::Layout::Paged);
+        assembleInstructionSetA(source, processLabels(source), memory);
+    });
+    bestLinesPerSecond("assembleParallel", lines, runs, [&] {
+        AsmSymbolTable labels;
+        LC3Memory memory(LC3Memory::Layout::Paged);
+        assembleParallel(source, labels, memory);
+    });
+
+    if (!diagnostics.isEmpty())
+    {
+        std::fprintf(stderr, "Line %d: %s\n", diagnostics.front().line, qPrintable(diagnostics.front().message));
+        return 1; // A benchmark of a failing build measures the wrong thing
+    }
+    return 0;
+}
@@ -0,0 +1,7 @@
+QT = core concurrent
+CONFIG += c++20 console release
+CONFIG -= app_bundle
+
+include(../../lc3core.pri)
+
+SOURCES += bench_assembler.cpp
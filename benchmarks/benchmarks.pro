@@ -0,0 +1,6 @@
+# Benchmarks for the core library. Build with qmake && make, then run each
+# benchmark's executable from a release build.
+TEMPLATE = subdirs
+
+SUBDIRS = \
+    bench_assembler
@@ -0,0 +1,376 @@
+#include "incrementalassembler.h"
+#include "AssemblerLogic.h"
+#include <utility>
+
+struct IncrementalAssembler::Line
+{
+    enum class Kind { Blank, Org, End, Statement };
+
+    std::string text;
+
+    // Parse result, fixed until the text of the line changes
+    Kind kind = Kind::Blank;
+    QString label;
+    uint16_t org = 0;
+    uint16_t word = 0;   // Encoding with the PC offset field zero
+    QString target;      // Label of the PC offset field, if any
+    uint8_t targetWidth = 0;
+    QString error;       // Why the statement was rejected
+    bool isBlock = false;
+    bool readsFile = false; // .INCBIN
+    AsmBlock block;      // Words of a block directive; empty and size 0 if rejected
+
+    // Layout: the address and END state the line starts at
+    uint16_t address = 0;
+    bool ended = false;
+    bool placed = false; // Its words are in the image
+    uint16_t resolved = 0; // word with the PC offset filled in
+    QString linkError;
+
+    bool active() const { return !ended; }
+    bool occupies() const { return kind == Kind::Statement && active(); } // Takes an address even if rejected
+    uint32_t size() const { return isBlock ? block.size : 1; }
+    bool covers(uint16_t at) const { return static_cast<uint16_t>(at - address) < size(); }
+    uint16_t nextAddress() const
+    {
+        if (kind == Kind::Org && active())
+            return org;
+        return address + (occupies() ? size() : 0);
+    }
+    bool nextEnded() const { return ended || kind == Kind::End; }
+};
+
+IncrementalAssembler::IncrementalAssembler()
+    : memory(LC3Memory::Layout::Paged), occupancy(LC3Memory::Size, 0)
+{
+}
+
+IncrementalAssembler::~IncrementalAssembler() = default;
+
+void IncrementalAssembler::parse(Line &line)
+{
+    AsmLexer lexer(line.text);
+    AsmLine lexed;
+    if (!lexer.nextLine(lexed))
+        return; // Blank or comment
+
+    if (lexed.label)
+        line.label = QString::fromUtf8(lexed.label->text.data(), static_cast<int>(lexed.label->text.size()));
+
+    AsmTokens tokens = lexed.statement;
+    if (tokens.empty())
+        return;
+
+    const Lc3InstructionDesc *desc = lc3FindMnemonic(tokens[0].text);
+    if (desc && desc->kind == Lc3EntryKind::Org)
+    {
+        int address = 0;
+        if (tokens.size() < 2 || !asmParseInteger(tokens[1].text, 16, address) || address < 0 || address > 0xFFFF)
+            line.error = "Invalid ORG address";
+        else
+        {
+            line.kind = Line::Kind::Org;
+            line.org = static_cast<uint16_t>(address);
+        }
+        return;
+    }
+    if (desc && desc->kind == Lc3EntryKind::End)
+    {
+        line.kind = Line::Kind::End;
+        return;
+    }
+    if (desc && (desc->kind == Lc3EntryKind::Export || desc->kind == Lc3EntryKind::Import))
+        return; // Only meaningful when linking modules
+
+    line.kind = Line::Kind::Statement;
+    if (desc && desc->kind == Lc3EntryKind::Block)
+    {
+        line.isBlock = true;
+        line.readsFile = desc->mnemonic == ".INCBIN";
+        expandBlockDirective(tokens, line.block, line.error);
+        return;
+    }
+    if (!assembleDeferred(tokens, line.word, line.target, line.targetWidth, line.error) && line.error.isEmpty())
+        line.error = "Invalid instruction";
+}
+
+bool IncrementalAssembler::failed(const Line *line) const
+{
+    return line->active() && (!line->error.isEmpty() || !line->linkError.isEmpty());
+}
+
+// A block's words are written in one go; a block that does not fit is never placed
+void IncrementalAssembler::place(Line *line)
+{
+    for (uint32_t i = 0; i < line->size(); ++i)
+    {
+        if (++occupancy[line->address + i] == 2)
+            overlaps++;
+    }
+    if (line->isBlock)
+        writeAsmBlock(line->block, line->address, memory);
+    else
+        memory.write(line->address, line->resolved);
+    line->placed = true;
+}
+
+void IncrementalAssembler::unplace(Line *line)
+{
+    for (uint32_t i = 0; i < line->size(); ++i)
+    {
+        uint16_t address = static_cast<uint16_t>(line->address + i);
+        uint32_t &count = occupancy[address];
+        if (count-- == 2)
+        {
+            overlaps--;
+            uncovered.insert(address); // The word left there may be this line's
+        }
+        if (count == 0)
+            memory.write(address, 0);
+    }
+    line->placed = false;
+}
+
+// Takes the line out of the symbol table, the reference graph and the image
+void IncrementalAssembler::detach(Line *line)
+{
+    if (failed(line))
+        failures--;
+    if (line->placed)
+        unplace(line);
+    if (line->active())
+    {
+        if (line->readsFile)
+            fileLines--;
+        if (!line->label.isEmpty())
+        {
+            QVector<Line *> &lines = definitions[line->label];
+            lines.removeOne(line);
+            if (lines.size() == 1)
+                duplicateLabels--;
+            if (lines.isEmpty())
+                definitions.remove(line->label);
+            moved.insert(line->label);
+        }
+        if (!line->target.isEmpty())
+        {
+            QSet<Line *> &lines = users[line->target];
+            lines.remove(line);
+            if (lines.isEmpty())
+                users.remove(line->target);
+        }
+    }
+    line->linkError.clear();
+}
+
+// Puts the line back at its current layout position
+void IncrementalAssembler::attach(Line *line)
+{
+    if (line->active())
+    {
+        if (line->readsFile)
+            fileLines++;
+        if (!line->label.isEmpty())
+        {
+            QVector<Line *> &lines = definitions[line->label];
+            lines.append(line);
+            if (lines.size() == 2)
+                duplicateLabels++;
+            moved.insert(line->label);
+        }
+        if (!line->target.isEmpty())
+            users[line->target].insert(line);
+    }
+    if (line->occupies() && line->error.isEmpty())
+    {
+        relink(line);
+        if (line->linkError.isEmpty() || !line->isBlock)
+            place(line);
+    }
+    else if (failed(line))
+        failures++;
+}
+
+// Resolves the PC offset against the current symbol table and rewrites the word
+// if it is already in the image
+void IncrementalAssembler::relink(Line *line)
+{
+    bool wasFailed = failed(line);
+    reencoded++;
+
+    line->resolved = line->word;
+    line->linkError.clear();
+    if (line->isBlock)
+    {
+        if (!line->block.fitsAt(line->address))
+            line->linkError = "Block runs past xFFFF";
+        else if (line->placed)
+            writeAsmBlock(line->block, line->address, memory);
+    }
+    else if (!line->target.isEmpty())
+    {
+        const QVector<Line *> lines = definitions.value(line->target);
+        uint16_t packed = 0;
+        if (lines.isEmpty())
+            line->linkError = "Undefined label " + line->target;
+        else if (!lc3SignedField(static_cast<int16_t>(lines.last()->address - line->address - 1), line->targetWidth, packed))
+            line->linkError = "PC offset to " + line->target + " out of range";
+        line->resolved |= packed;
+    }
+
+    if (line->placed && !line->isBlock)
+        memory.write(line->address, line->resolved);
+    if (wasFailed != failed(line))
+        wasFailed ? failures-- : failures++;
+}
+
+void IncrementalAssembler::update(std::string_view source)
+{
+    std::vector<std::string_view> text;
+    std::size_t start = 0;
+    for (std::size_t i = 0; i <= source.size(); ++i)
+    {
+        if (i == source.size() || source[i] == '\n')
+        {
+            text.push_back(source.substr(start, i - start));
+            start = i + 1;
+        }
+    }
+
+    // Unchanged lines at both ends keep their parse results
+    std::size_t oldCount = lines.size(), newCount = text.size();
+    std::size_t prefix = 0, suffix = 0;
+    while (prefix < oldCount && prefix < newCount && lines[prefix]->text == text[prefix])
+        prefix++;
+    while (suffix < oldCount - prefix && suffix < newCount - prefix
+           && lines[oldCount - 1 - suffix]->text == text[newCount - 1 - suffix])
+        suffix++;
+
+    for (std::size_t i = prefix; i < oldCount - suffix; ++i)
+        detach(lines[i].get());
+    lines.erase(lines.begin() + prefix, lines.begin() + (oldCount - suffix));
+
+    std::vector<std::unique_ptr<Line>> fresh;
+    fresh.reserve(newCount - suffix - prefix);
+    for (std::size_t i = prefix; i < newCount - suffix; ++i)
+    {
+        auto line = std::make_unique<Line>();
+        line->text.assign(text[i]);
+        parse(*line);
+        fresh.push_back(std::move(line));
+    }
+    reparsed = fresh.size();
+    reencoded = 0;
+    lines.insert(lines.begin() + prefix, std::make_move_iterator(fresh.begin()), std::make_move_iterator(fresh.end()));
+
+    // Lay out from the first change until a kept line starts where it did before.
+    // Everything that moves is detached before anything is re-attached, so a block
+    // shifting by one word never looks like it overlaps itself.
+    std::vector<Line *> relaid;
+    uint16_t address = prefix == 0 ? 0x3000 : lines[prefix - 1]->nextAddress();
+    bool ended = prefix == 0 ? false : lines[prefix - 1]->nextEnded();
+    for (std::size_t i = prefix; i < newCount; ++i)
+    {
+        Line *line = lines[i].get();
+        if (i >= newCount - suffix)
+        {
+            if (line->address == address && line->ended == ended)
+                break;
+            detach(line);
+        }
+        line->address = address;
+        line->ended = ended;
+        relaid.push_back(line);
+        address = line->nextAddress();
+        ended = line->nextEnded();
+    }
+    for (Line *line : relaid)
+        attach(line);
+
+    // Lines whose target label was defined, removed or moved
+    for (const QString &label : std::as_const(moved))
+    {
+        for (Line *line : users.value(label))
+        {
+            if (line->placed)
+                relink(line);
+        }
+    }
+    moved.clear();
+
+    // An overlap that went away may have left the departing line's word behind
+    for (uint16_t address : std::as_const(uncovered))
+    {
+        if (occupancy[address] != 1)
+            continue;
+        for (const auto &line : lines)
+        {
+            if (line->placed && line->covers(address))
+            {
+                relink(line.get());
+                break;
+            }
+        }
+    }
+    uncovered.clear();
+}
+
+uint32_t IncrementalAssembler::endAddress() const
+{
+    for (uint32_t address = LC3Memory::Size; address > 0x3000; --address)
+    {
+        if (occupancy[address - 1])
+            return address;
+    }
+    return 0x3000;
+}
+
+void IncrementalAssembler::sourceMap(AsmSourceMap &map) const
+{
+    map.clear();
+    for (std::size_t i = 0; i < lines.size(); ++i)
+    {
+        if (lines[i]->placed)
+            map.add({lines[i]->address, lines[i]->size(), static_cast<uint32_t>(i + 1)});
+    }
+    map.finish();
+}
+
+void IncrementalAssembler::labels(AsmSymbolTable &labels) const
+{
+    labels.clear();
+    for (const auto &line : lines)
+    {
+        if (line->active() && !line->label.isEmpty())
+            labels.insert(line->label, line->address);
+    }
+}
+
+AsmDiagnostics IncrementalAssembler::diagnostics() const
+{
+    AsmDiagnostics messages;
+    for (std::size_t i = 0; i < lines.size(); ++i)
+    {
+        const Line *line = lines[i].get();
+        if (!line->active())
+            break;
+        int number = static_cast<int>(i + 1);
+        QString prefix = QString("Line %1: ").arg(number);
+        if (!line->error.isEmpty())
+            messages.append({number, prefix + line->error});
+        if (!line->linkError.isEmpty())
+            messages.append({number, prefix + line->linkError});
+        if (!line->label.isEmpty() && definitions.value(line->label).size() > 1)
+            messages.append({number, prefix + "Label " + line->label + " defined more than once"});
+        for (uint32_t w = 0; line->placed && w < line->size(); ++w)
+        {
+            uint16_t address = static_cast<uint16_t>(line->address + w);
+            if (occupancy[address] > 1)
+            {
+                messages.append({number, prefix + "Overlaps another word at x" + QString("%1").arg(address, 4, 16, QChar('0')).toUpper()});
+                break;
+            }
+        }
+    }
+    return messages;
+}
@@ -0,0 +1,80 @@
+#ifndef INCREMENTALASSEMBLER_H
+#define INCREMENTALASSEMBLER_H
+
+#include "asmdiagnostics.h"
+#include "asmsourcemap.h"
+#include "asmsymbols.h"
+#include "lc3memory.h"
+#include <QHash>
+#include <QSet>
+#include <QString>
+#include <QVector>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+// Keeps the assembled image of an editor buffer current as the text changes.
+// Every source line keeps its parse result: its label, its encoding with any PC
+// offset left zero, and the label that offset refers to. Each label also knows
+// which lines refer to it.
+// update() diffs the new text against the previous lines and re-lexes only the
+// lines that differ. It then lays out addresses from the first change until they
+// agree with the old layout again. Finally it re-encodes the lines that moved and
+// the lines whose target label moved.
+// Not thread-safe: one update() at a time, and image() must not be read while an
+// update() is running.
+class IncrementalAssembler
+{
+public:
+    IncrementalAssembler();
+    ~IncrementalAssembler();
+    IncrementalAssembler(const IncrementalAssembler &) = delete;
+    IncrementalAssembler &operator=(const IncrementalAssembler &) = delete;
+
+    void update(std::string_view source);
+
+    // True when image() is exactly what assembleSinglePass() would produce: no
+    // rejected lines, no undefined or duplicate labels, no two words at one address.
+    // Never true while a line uses .INCBIN: the editor buffer has no directory to
+    // resolve the file against, and the file may change without an edit.
+    bool isClean() const { return failures == 0 && duplicateLabels == 0 && overlaps == 0 && fileLines == 0; }
+    AsmDiagnostics diagnostics() const; // "Line N: message", in source order
+
+    const LC3Memory &image() const { return memory; }
+    uint32_t endAddress() const; // One past the highest address written, at least x3000
+    void sourceMap(AsmSourceMap &map) const; // The lines that wrote the image, finished
+    void labels(AsmSymbolTable &labels) const; // Labels defined before END, in source order
+
+    // Work done by the last update(), for profiling
+    std::size_t lastReparsed() const { return reparsed; }
+    std::size_t lastReencoded() const { return reencoded; }
+
+private:
+    struct Line;
+
+    void parse(Line &line);
+    void attach(Line *line);
+    void detach(Line *line);
+    void relink(Line *line);
+    void place(Line *line);
+    void unplace(Line *line);
+    bool failed(const Line *line) const;
+
+    std::vector<std::unique_ptr<Line>> lines;
+    QHash<QString, QVector<Line *>> definitions; // Only lines before END define labels
+    QHash<QString, QSet<Line *>> users;          // Lines with a PC offset to each label
+    QSet<QString> moved;                         // Labels defined, removed or moved by this update
+    QSet<uint16_t> uncovered;                    // Overlapping addresses left with one owner
+
+    LC3Memory memory;
+    std::vector<uint32_t> occupancy; // Words placed at each address
+    std::size_t failures = 0;        // Lines before END with a parse or link error
+    std::size_t duplicateLabels = 0;
+    std::size_t overlaps = 0;        // Addresses holding more than one word
+    std::size_t fileLines = 0;       // .INCBIN lines before END
+    std::size_t reparsed = 0;
+    std::size_t reencoded = 0;
+};
+
+#endif // INCREMENTALASSEMBLER_H
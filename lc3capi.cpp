@@ -0,0 +1,207 @@
+#include "lc3capi.h"
+#include "asmdiagnostics.h"
+#include "asmpreprocessor.h"
+#include "asmsections.h"
+#include "asmsourcemap.h"
+#include "lc3machine.h"
+#include "lc3programfile.h"
+#include <QString>
+#include <new>
+#include <string>
+#include <string_view>
+
+struct lc3_machine
+{
+    LC3Machine machine;
+    AsmIncludeCache includes; // .INCLUDE files stay lexed across lc3_load_source calls
+    std::string error;
+};
+
+static lc3_status toStatus(LC3Machine::Status status)
+{
+    switch (status)
+    {
+    case LC3Machine::Status::Running: return LC3_OK;
+    case LC3Machine::Status::Halted: return LC3_HALTED;
+    case LC3Machine::Status::Breakpoint: return LC3_BREAKPOINT;
+    case LC3Machine::Status::UnhandledTrap: return LC3_UNHANDLED_TRAP;
+    }
+    return LC3_ERROR;
+}
+
+static lc3_status fail(lc3_machine *machine, const QString &message)
+{
+    machine->error = message.toStdString();
+    return LC3_ERROR;
+}
+
+int lc3_api_version(void)
+{
+    return LC3_API_VERSION;
+}
+
+// Nothing may throw across the C boundary; the core only ever throws bad_alloc
+lc3_machine *lc3_create(void)
+{
+    return new (std::nothrow) lc3_machine;
+}
+
+void lc3_destroy(lc3_machine *machine)
+{
+    delete machine;
+}
+
+void lc3_reset(lc3_machine *machine)
+{
+    machine->machine.reset();
+}
+
+const char *lc3_last_error(const lc3_machine *machine)
+{
+    return machine->error.c_str();
+}
+
+lc3_status lc3_load_image(lc3_machine *machine, const char *path)
+{
+    try
+    {
+        LC3ProgramFile program(QString::fromUtf8(path));
+        if (!program.open())
+            return fail(machine, program.errorString());
+        program.load(machine->machine.memory());
+        machine->machine.registers().setPC(program.entry());
+        machine->error.clear();
+        return LC3_OK;
+    }
+    catch (const std::bad_alloc &)
+    {
+        return fail(machine, "Out of memory");
+    }
+}
+
+lc3_status lc3_load_source(lc3_machine *machine, const char *source, size_t length)
+{
+    try
+    {
+        // The same build as the simulator's, with .INCLUDE and .INCBIN relative to
+        // the working directory
+        AsmDiagnostics diagnostics;
+        AsmPreprocessed expanded;
+        AsmSymbolTable labels;
+        AsmSourceMap sourceMap;
+        LC3Memory image(LC3Memory::Layout::Paged);
+        std::string_view text;
+        {
+            AsmDiagnosticCollector collect(diagnostics);
+            text = expandAssembly(std::string_view(source, length), QString(), machine->includes, expanded);
+        }
+        assembleExpanded(text, expanded, QString(), labels, image, sourceMap, diagnostics);
+        if (!diagnostics.isEmpty())
+        {
+            QString messages;
+            for (const AsmDiagnostic &diagnostic : diagnostics)
+                messages += diagnostic.message + '\n'; // Each message names its line
+            return fail(machine, messages);
+        }
+
+        uint16_t entry = 0x3000;
+        sourceMap.entryPoint(entry);
+        machine->machine.memory().loadImage(LC3MemoryImage::capture(image));
+        machine->machine.registers().setPC(entry);
+        machine->error.clear();
+        return LC3_OK;
+    }
+    catch (const std::bad_alloc &)
+    {
+        return fail(machine, "Out of memory");
+    }
+}
+
+lc3_status lc3_step(lc3_machine *machine)
+{
+    return toStatus(machine->machine.step());
+}
+
+lc3_status lc3_run(lc3_machine *machine, uint64_t budget, uint64_t *executed)
+{
+    uint64_t count = 0;
+    LC3Machine::Status status = machine->machine.run(budget, count);
+    if (executed)
+        *executed = count;
+    return toStatus(status);
+}
+
+uint16_t lc3_get_register(const lc3_machine *machine, lc3_register reg)
+{
+    const LC3Registers &registers = machine->machine.registers();
+    switch (reg)
+    {
+    case LC3_PC: return registers.getPC();
+    case LC3_IR: return registers.getIR();
+    case LC3_CC: return registers.getCC();
+    case LC3_MAR: return registers.getMAR();
+    case LC3_MDR: return registers.getMDR();
+    default: return reg >= LC3_R0 && reg <= LC3_R7 ? registers.getR(static_cast<uint8_t>(reg)) : 0;
+    }
+}
+
+void lc3_set_register(lc3_machine *machine, lc3_register reg, uint16_t value)
+{
+    LC3Registers &registers = machine->machine.registers();
+    switch (reg)
+    {
+    case LC3_PC: registers.setPC(value); break;
+    case LC3_IR: registers.setIR(value); break;
+    case LC3_CC: registers.setCC(value); break;
+    case LC3_MAR: registers.setMAR(value); break;
+    case LC3_MDR: registers.setMDR(value); break;
+    default:
+        if (reg >= LC3_R0 && reg <= LC3_R7)
+            registers.setR(static_cast<uint8_t>(reg), value);
+        break;
+    }
+}
+
+void lc3_get_registers(const lc3_machine *machine, uint16_t *values)
+{
+    for (int reg = 0; reg < LC3_REGISTER_COUNT; ++reg)
+        values[reg] = lc3_get_register(machine, static_cast<lc3_register>(reg));
+}
+
+void lc3_set_registers(lc3_machine *machine, const uint16_t *values)
+{
+    for (int reg = 0; reg < LC3_REGISTER_COUNT; ++reg)
+        lc3_set_register(machine, static_cast<lc3_register>(reg), values[reg]);
+}
+
+size_t lc3_read_memory(const lc3_machine *machine, uint16_t address, uint16_t *words, size_t count)
+{
+    return machine->machine.memory().readBlock(address, std::span<uint16_t>(words, count));
+}
+
+size_t lc3_write_memory(lc3_machine *machine, uint16_t address, const uint16_t *words, size_t count)
+{
+    return machine->machine.memory().writeBlock(address, std::span<const uint16_t>(words, count));
+}
+
+void lc3_set_breakpoint(lc3_machine *machine, uint16_t address, int enabled)
+{
+    machine->machine.setBreakpoint(address, enabled != 0);
+}
+
+void lc3_clear_breakpoints(lc3_machine *machine)
+{
+    machine->machine.clearBreakpoints();
+}
+
+void lc3_set_trap_handler(lc3_machine *machine, lc3_trap_handler handler, void *user_data)
+{
+    if (!handler)
+    {
+        machine->machine.setTrapHandler(nullptr);
+        return;
+    }
+    machine->machine.setTrapHandler([machine, handler, user_data](LC3Machine &, uint8_t vector) {
+        return handler(machine, vector, user_data) != 0;
+    });
+}
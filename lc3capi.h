@@ -0,0 +1,114 @@
+#ifndef LC3CAPI_H
+#define LC3CAPI_H
+
+/*
+ * C interface to the LC3 simulator core, built as a shared library by
+ * lc3capi.pro. It is plain C with fixed-width types, so any language with a C
+ * FFI can load it. Functions that are not marked otherwise may be called on any
+ * machine from any thread, as long as no two threads use the same machine at
+ * once.
+ *
+ * Compatibility: existing functions and enum values never change meaning;
+ * additions raise LC3_API_VERSION.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32)
+#  if defined(LC3_BUILD_SHARED)
+#    define LC3_API __declspec(dllexport)
+#  else
+#    define LC3_API __declspec(dllimport)
+#  endif
+#else
+#  define LC3_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LC3_API_VERSION 1
+
+typedef struct lc3_machine lc3_machine;
+
+typedef enum lc3_status
+{
+    LC3_OK = 0,             /* Step done, or the run used up its budget */
+    LC3_HALTED = 1,         /* PC is on a HALT that no trap handler took */
+    LC3_BREAKPOINT = 2,     /* PC is on a breakpoint */
+    LC3_UNHANDLED_TRAP = 3, /* PC is on a TRAP that no trap handler took */
+    LC3_ERROR = -1          /* See lc3_last_error() */
+} lc3_status;
+
+typedef enum lc3_register
+{
+    LC3_R0, LC3_R1, LC3_R2, LC3_R3, LC3_R4, LC3_R5, LC3_R6, LC3_R7,
+    LC3_PC, LC3_IR, LC3_CC, LC3_MAR, LC3_MDR,
+    LC3_REGISTER_COUNT
+} lc3_register;
+
+/*
+ * Called for every TRAP before the machine acts on it, with PC already past the
+ * TRAP. Return nonzero if the trap was handled; the handler may use any
+ * function below on the machine, except lc3_destroy, lc3_step and lc3_run.
+ * Return zero and HALT (x25) stops the machine; any other vector stops it with
+ * LC3_UNHANDLED_TRAP.
+ */
+typedef int (*lc3_trap_handler)(lc3_machine *machine, uint8_t vector, void *user_data);
+
+/* LC3_API_VERSION of the library loaded, which may be newer than the header */
+LC3_API int lc3_api_version(void);
+
+/* A machine with zeroed registers and memory; NULL if out of memory */
+LC3_API lc3_machine *lc3_create(void);
+LC3_API void lc3_destroy(lc3_machine *machine);
+
+/* Zeroes registers and memory. Breakpoints and the trap handler stay. */
+LC3_API void lc3_reset(lc3_machine *machine);
+
+/* Why the last call on this machine failed, and the assembler's diagnostics
+ * one per line. Valid until the next call on the machine. */
+LC3_API const char *lc3_last_error(const lc3_machine *machine);
+
+/* Loads a program file (MEMORY.lc3) written by the simulator: clears memory,
+ * copies every segment and sets PC to the program's entry point. */
+LC3_API lc3_status lc3_load_image(lc3_machine *machine, const char *path);
+
+/* Assembles length bytes of UTF-8 source into a cleared memory and sets PC to
+ * its first statement. LC3_ERROR, with the machine unchanged, if the assembler
+ * reports anything. */
+LC3_API lc3_status lc3_load_source(lc3_machine *machine, const char *source, size_t length);
+
+/* Executes one instruction; breakpoints are ignored */
+LC3_API lc3_status lc3_step(lc3_machine *machine);
+
+/* Executes up to budget instructions. Stops early at a HALT, an unhandled TRAP
+ * or a breakpoint (the instruction PC starts on is run even if it has one, so a
+ * run resumes past it). executed, if not NULL, receives the number of
+ * instructions completed. */
+LC3_API lc3_status lc3_run(lc3_machine *machine, uint64_t budget, uint64_t *executed);
+
+LC3_API uint16_t lc3_get_register(const lc3_machine *machine, lc3_register reg);
+LC3_API void lc3_set_register(lc3_machine *machine, lc3_register reg, uint16_t value);
+/* All LC3_REGISTER_COUNT registers at once, in lc3_register order */
+LC3_API void lc3_get_registers(const lc3_machine *machine, uint16_t *values);
+LC3_API void lc3_set_registers(lc3_machine *machine, const uint16_t *values);
+
+/* Copy count words starting at address; a range running past xFFFF is cut
+ * short. Both return the number of words copied. */
+LC3_API size_t lc3_read_memory(const lc3_machine *machine, uint16_t address, uint16_t *words, size_t count);
+LC3_API size_t lc3_write_memory(lc3_machine *machine, uint16_t address, const uint16_t *words, size_t count);
+
+LC3_API void lc3_set_breakpoint(lc3_machine *machine, uint16_t address, int enabled);
+LC3_API void lc3_clear_breakpoints(lc3_machine *machine);
+
+/* Replaces the trap handler; NULL removes it */
+LC3_API void lc3_set_trap_handler(lc3_machine *machine, lc3_trap_handler handler, void *user_data);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LC3CAPI_H */
@@ -0,0 +1,15 @@
+# The simulator core behind the C interface in lc3capi.h, as a shared library
+# (liblc3) for test harnesses and tools written in other languages. Only the
+# lc3_* functions are exported.
+TEMPLATE = lib
+TARGET = lc3
+CONFIG += shared c++20 hide_symbols
+
+QT = core concurrent
+
+DEFINES += LC3_BUILD_SHARED
+
+include(lc3core.pri)
+
+SOURCES += $$PWD/lc3capi.cpp
+HEADERS += $$PWD/lc3capi.h
@@ -0,0 +1,259 @@
+#include "lc3checkpoint.h"
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStringList>
+#include <QtConcurrent/QtConcurrentRun>
+#include <QtEndian>
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <vector>
+
+static const char CheckpointMagic[8] = {'L', 'C', '3', 'C', 'K', 'P', 'T', 0};
+
+// A chain longer than this means parent names that loop
+static constexpr int MaxChain = 1 << 16;
+
+// R0-R7, PC, IR, CC, MAR, MDR
+using RegisterFile = std::array<quint16, 13>;
+
+static RegisterFile saveRegisters(const LC3Registers &registers)
+{
+    RegisterFile file;
+    for (uint8_t i = 0; i < 8; ++i)
+        file[i] = registers.getR(i);
+    file[8] = registers.getPC();
+    file[9] = registers.getIR();
+    file[10] = registers.getCC();
+    file[11] = registers.getMAR();
+    file[12] = registers.getMDR();
+    return file;
+}
+
+static void loadRegisters(const RegisterFile &file, LC3Registers &registers)
+{
+    for (uint8_t i = 0; i < 8; ++i)
+        registers.setR(i, file[i]);
+    registers.setPC(file[8]);
+    registers.setIR(file[9]);
+    registers.setCC(file[10]);
+    registers.setMAR(file[11]);
+    registers.setMDR(file[12]);
+}
+
+static QString checkpointName(uint32_t sequence)
+{
+    return QString("checkpoint-%1.lc3ckpt").arg(sequence, 6, 10, QChar('0'));
+}
+
+// Runs on the writer thread. With base, only pages whose pointer differs from
+// base's are written: capture() shares every page it did not have to copy.
+static bool writeCheckpoint(const QString &path, uint32_t sequence, const QString &parent, const RegisterFile &registers,
+                            const LC3MemoryImage &image, const LC3MemoryImage *base, QString &error)
+{
+    std::vector<uint16_t> pages;
+    for (std::size_t page = 0; page < LC3Memory::PageCount; ++page)
+    {
+        if (base ? image.page(page) != base->page(page) : image.page(page) != nullptr)
+            pages.push_back(static_cast<uint16_t>(page));
+    }
+
+    QByteArray data;
+    QDataStream out(&data, QIODevice::WriteOnly);
+    out.setByteOrder(QDataStream::LittleEndian);
+    out.writeRawData(CheckpointMagic, sizeof(CheckpointMagic));
+    out << quint32(LC3Checkpointer::Version) << quint32(sequence) << parent;
+    for (quint16 value : registers)
+        out << value;
+    out << quint32(pages.size());
+    for (uint16_t page : pages)
+    {
+        const std::shared_ptr<LC3Memory::Page> &words = image.page(page);
+        if (!words)
+        {
+            out << quint16(page | LC3Checkpointer::ClearedPage);
+            continue;
+        }
+        std::array<uint16_t, LC3Memory::PageSize> little;
+        qToLittleEndian<quint16>(words->data(), little.size(), little.data());
+        out << quint16(page);
+        out.writeRawData(reinterpret_cast<const char *>(little.data()), int(sizeof(little)));
+    }
+
+    QSaveFile file(path); // A checkpoint is either all there or not there
+    if (!file.open(QIODevice::WriteOnly) || file.write(data) != data.size() || !file.commit())
+    {
+        error = "Cannot write " + path + ": " + file.errorString();
+        return false;
+    }
+    return true;
+}
+
+LC3Checkpointer::LC3Checkpointer(const QString &directory, int fullEvery)
+    : directory(directory), fullEvery(std::max(fullEvery, 1))
+{
+    QDir().mkpath(directory);
+    writer.setMaxThreadCount(1);
+
+    // Carry on after checkpoints left by an earlier session instead of overwriting them
+    const QStringList existing = QDir(directory).entryList(QStringList{"checkpoint-*.lc3ckpt"}, QDir::Files);
+    for (const QString &name : existing)
+        sequence = std::max<uint32_t>(sequence, name.mid(11, 6).toUInt());
+}
+
+LC3Checkpointer::~LC3Checkpointer()
+{
+    writer.waitForDone();
+}
+
+QFuture<bool> LC3Checkpointer::checkpoint(const LC3Registers &registers, const LC3Memory &memory, bool full)
+{
+    {
+        QMutexLocker lock(&errorMutex);
+        full = full || chainBroken || previousFile.isEmpty() || sinceFull + 1 >= fullEvery;
+    }
+    LC3MemoryImage image = LC3MemoryImage::capture(memory, previous);
+    QString path = QDir(directory).filePath(checkpointName(++sequence));
+    QString parent = full ? QString() : QFileInfo(previousFile).fileName();
+
+    // The images are immutable and share their pages, so handing copies to the
+    // writer thread costs a few hundred pointer copies
+    pending = QtConcurrent::run(&writer, [this, path, sequence = sequence, parent, registers = saveRegisters(registers),
+                                          image, base = previous, full]() {
+        // Writes run one at a time in call order, so chainBroken says whether
+        // the parent made it to disk. If it did not, save everything instead.
+        bool asFull = full;
+        {
+            QMutexLocker lock(&errorMutex);
+            asFull = asFull || chainBroken;
+        }
+        QString message;
+        bool written = writeCheckpoint(path, sequence, asFull ? QString() : parent, registers, image,
+                                       asFull ? nullptr : &base, message);
+        QMutexLocker lock(&errorMutex);
+        chainBroken = !written;
+        if (!written)
+            error = message;
+        return written;
+    });
+
+    sinceFull = full ? 0 : sinceFull + 1;
+    previous = image;
+    previousFile = path;
+    return pending;
+}
+
+void LC3Checkpointer::waitForFinished()
+{
+    writer.waitForDone();
+}
+
+QString LC3Checkpointer::errorString() const
+{
+    QMutexLocker lock(&errorMutex);
+    return error;
+}
+
+namespace {
+
+struct Checkpoint
+{
+    uint32_t sequence = 0;
+    QString parent;
+    RegisterFile registers{};
+    std::vector<std::pair<quint16, LC3Memory::Page>> pages; // Index with ClearedPage, words
+};
+
+bool readCheckpoint(const QString &path, Checkpoint &checkpoint, QString &error)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        error = "Cannot open checkpoint " + path + ": " + file.errorString();
+        return false;
+    }
+    QByteArray data = file.readAll();
+    QDataStream in(data);
+    in.setByteOrder(QDataStream::LittleEndian);
+
+    char magic[sizeof(CheckpointMagic)];
+    quint32 version = 0, pageCount = 0;
+    if (in.readRawData(magic, sizeof(magic)) != int(sizeof(magic)) || std::memcmp(magic, CheckpointMagic, sizeof(magic)) != 0)
+    {
+        error = "Not an LC3 checkpoint: " + path;
+        return false;
+    }
+    in >> version >> checkpoint.sequence >> checkpoint.parent;
+    for (quint16 &value : checkpoint.registers)
+        in >> value;
+    in >> pageCount;
+    if (version != LC3Checkpointer::Version || pageCount > LC3Memory::PageCount)
+    {
+        error = "Unsupported or corrupt checkpoint: " + path;
+        return false;
+    }
+
+    checkpoint.pages.resize(pageCount);
+    for (auto &[index, words] : checkpoint.pages)
+    {
+        in >> index;
+        if ((index & ~LC3Checkpointer::ClearedPage) >= LC3Memory::PageCount)
+            in.setStatus(QDataStream::ReadCorruptData);
+        if (index & LC3Checkpointer::ClearedPage)
+            continue;
+        in.readRawData(reinterpret_cast<char *>(words.data()), int(sizeof(words)));
+        qFromLittleEndian<quint16>(words.data(), words.size(), words.data());
+    }
+    if (in.status() != QDataStream::Ok)
+    {
+        error = "Truncated or corrupt checkpoint: " + path;
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+bool LC3Checkpointer::restore(const QString &fileName, LC3Registers &registers, LC3Memory &memory, QString &error)
+{
+    // Newest first, back to the full checkpoint the chain starts from
+    std::vector<Checkpoint> chain;
+    QString path = fileName;
+    for (;;)
+    {
+        Checkpoint &checkpoint = chain.emplace_back();
+        if (!readCheckpoint(path, checkpoint, error))
+            return false;
+        if (chain.size() > 1 && checkpoint.sequence >= chain[chain.size() - 2].sequence)
+        {
+            error = "Checkpoint " + path + " is not older than the one built on it";
+            return false;
+        }
+        if (checkpoint.parent.isEmpty())
+            break;
+        if (chain.size() >= MaxChain)
+        {
+            error = "Checkpoint chain too long at " + path;
+            return false;
+        }
+        path = QDir(QFileInfo(path).absolutePath()).filePath(checkpoint.parent); // Parents sit beside their children
+    }
+
+    memory.clear();
+    for (auto it = chain.rbegin(); it != chain.rend(); ++it)
+    {
+        for (const auto &[index, words] : it->pages)
+        {
+            uint16_t start = static_cast<uint16_t>((index & ~ClearedPage) * LC3Memory::PageSize);
+            if (index & ClearedPage)
+                memory.fill(start, LC3Memory::PageSize, 0);
+            else
+                memory.writeBlock(start, words);
+        }
+    }
+    loadRegisters(chain.front().registers, registers);
+    return true;
+}
@@ -0,0 +1,63 @@
+#ifndef LC3CHECKPOINT_H
+#define LC3CHECKPOINT_H
+
+#include "lc3memory.h"
+#include "lc3registers.h"
+#include <QFuture>
+#include <QMutex>
+#include <QString>
+#include <QThreadPool>
+#include <cstdint>
+
+// Saves the whole machine (R0-R7, PC, IR, CC, MAR, MDR and memory) to
+// <directory>/checkpoint-NNNNNN.lc3ckpt files. A full checkpoint holds every
+// non-zero page; an incremental one names the checkpoint before it and holds
+// only the pages that changed since then, including pages that went back to zero.
+//
+// Layout (little-endian, as QDataStream writes it): "LC3CKPT\0", version,
+// sequence, the parent's file name (empty for a full checkpoint), the 13
+// registers, the page count, then each page as its index (ClearedPage set for a
+// page that is now zero) followed by its 256 words unless cleared.
+class LC3Checkpointer
+{
+public:
+    static constexpr uint32_t Version = 1;
+    static constexpr uint16_t ClearedPage = 0x8000;
+
+    // Every fullEvery-th checkpoint is full, so a restore reads at most that many files
+    explicit LC3Checkpointer(const QString &directory, int fullEvery = 16);
+    ~LC3Checkpointer(); // Waits for the writes still in flight
+
+    // Captures the machine on the calling thread and writes the file on a
+    // background thread. The capture memcmps every private page with the last
+    // checkpoint's copy: in paged memory each page written since the image was
+    // loaded, in flat memory all 256. Its cost follows the pages the program has
+    // touched, not the writes since the last checkpoint. Returns at once; the
+    // future is true once the file is on disk. Writes land in call order. An
+    // incremental checkpoint whose parent failed to write is saved full instead,
+    // so no file on disk names a parent that is not there.
+    QFuture<bool> checkpoint(const LC3Registers &registers, const LC3Memory &memory, bool full = false);
+    void waitForFinished();
+
+    QString latest() const { return previousFile; } // Newest checkpoint, empty before the first
+    QString errorString() const;                    // Why the last failed write failed
+
+    // Reads fileName and every checkpoint it builds on, then replaces registers
+    // and memory. Nothing is changed if a file in the chain is missing or corrupt.
+    static bool restore(const QString &fileName, LC3Registers &registers, LC3Memory &memory, QString &error);
+
+private:
+    QString directory;
+    int fullEvery;
+    uint32_t sequence = 0;
+    int sinceFull = 0;
+    LC3MemoryImage previous;  // What the last checkpoint saved
+    QString previousFile;
+    QThreadPool writer;       // One thread
+    QFuture<bool> pending;
+    mutable QMutex errorMutex; // Guards error and chainBroken
+    QString error;
+    bool chainBroken = false;  // The last write failed, so the next checkpoint is full
+};
+
+#endif // LC3CHECKPOINT_H
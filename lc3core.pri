@@ -0,0 +1,48 @@
+# Assembler, memory and file code with no QtWidgets dependency. Included by
+# lc3core.pro to build the core library and by Lc3.pro for the simulator.
+
+SOURCES += \
+    $$PWD/AssemblerLogic.cpp \
+    $$PWD/asmdiagnostics.cpp \
+    $$PWD/asmlexer.cpp \
+    $$PWD/asmpeephole.cpp \
+    $$PWD/asmpreprocessor.cpp \
+    $$PWD/asmsections.cpp \
+    $$PWD/asmsourcemap.cpp \
+    $$PWD/asmsymbols.cpp \
+    $$PWD/incrementalassembler.cpp \
+    $$PWD/lc3checkpoint.cpp \
+    $$PWD/lc3imagecache.cpp \
+    $$PWD/lc3instructions.cpp \
+    $$PWD/lc3isa.cpp \
+    $$PWD/lc3machine.cpp \
+    $$PWD/lc3memory.cpp \
+    $$PWD/lc3memoryfile.cpp \
+    $$PWD/lc3object.cpp \
+    $$PWD/lc3programfile.cpp \
+    $$PWD/lc3registers.cpp \
+    $$PWD/memorysearch.cpp
+
+HEADERS += \
+    $$PWD/AssemblerLogic.h \
+    $$PWD/asmdiagnostics.h \
+    $$PWD/asmlexer.h \
+    $$PWD/asmpeephole.h \
+    $$PWD/asmpreprocessor.h \
+    $$PWD/asmsections.h \
+    $$PWD/asmsourcemap.h \
+    $$PWD/asmsymbols.h \
+    $$PWD/incrementalassembler.h \
+    $$PWD/lc3checkpoint.h \
+    $$PWD/lc3imagecache.h \
+    $$PWD/lc3instructions.h \
+    $$PWD/lc3isa.h \
+    $$PWD/lc3machine.h \
+    $$PWD/lc3memory.h \
+    $$PWD/lc3memoryfile.h \
+    $$PWD/lc3object.h \
+    $$PWD/lc3programfile.h \
+    $$PWD/lc3registers.h \
+    $$PWD/memorysearch.h
+
+INCLUDEPATH += $$PWD
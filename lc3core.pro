@@ -0,0 +1,9 @@
+# The assembler and memory model as a static library, for tools that assemble
+# without the simulator's windows. Diagnostics come back as AsmDiagnostics.
+TEMPLATE = lib
+TARGET = lc3core
+CONFIG += staticlib c++20
+
+QT = core concurrent
+
+include(lc3core.pri)
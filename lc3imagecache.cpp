@@ -0,0 +1,138 @@
+#include "lc3imagecache.h"
+#include "AssemblerLogic.h"
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QSaveFile>
+#include <QtEndian>
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+static const char ImageMagic[8] = {'L', 'C', '3', 'I', 'M', 'G', 0, 0};
+
+LC3ImageCache::LC3ImageCache(const QString &directory)
+    : directory(directory)
+{
+    QDir().mkpath(directory);
+}
+
+QByteArray LC3ImageCache::key(std::string_view source, const std::vector<AsmOrigin> &origins)
+{
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    hash.addData(QByteArrayView(source.data(), qsizetype(source.size())));
+    hash.addData(QByteArray::number(AssemblerVersion));
+
+    // The line of each origin, and the file name once per run of lines from it.
+    // A name follows a marker no line number reaches and its length, so the
+    // encoding cannot be read two ways.
+    const QString *file = nullptr;
+    for (const AsmOrigin &origin : origins)
+    {
+        if (!file || origin.file != *file)
+        {
+            file = &origin.file;
+            QByteArray name = file->toUtf8();
+            const quint32 header[] = {0xFFFFFFFFu, quint32(name.size())};
+            hash.addData(QByteArrayView(reinterpret_cast<const char *>(header), sizeof(header)));
+            hash.addData(name);
+        }
+        quint32 line = origin.line;
+        hash.addData(QByteArrayView(reinterpret_cast<const char *>(&line), sizeof(line)));
+    }
+    return hash.result().toHex();
+}
+
+QString LC3ImageCache::path(const QByteArray &key) const
+{
+    return QDir(directory).filePath(QString::fromLatin1(key) + ".lc3img");
+}
+
+// Layout: magic, version, end address, then each page the program wrote as its
+// index and 256 little-endian words, then the labels and the source map
+bool LC3ImageCache::lookup(const QByteArray &key, LC3Memory &memory, uint32_t &endAddress, AsmSymbolTable &labels,
+                           AsmSourceMap &sourceMap)
+{
+    QFile file(path(key));
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        cacheMisses++;
+        return false;
+    }
+    QByteArray data = file.readAll();
+    QDataStream in(data);
+    in.setByteOrder(QDataStream::LittleEndian);
+
+    char magic[sizeof(ImageMagic)];
+    quint32 version = 0, end = 0, pageCount = 0;
+    if (in.readRawData(magic, sizeof(magic)) != int(sizeof(magic)) || std::memcmp(magic, ImageMagic, sizeof(magic)) != 0)
+    {
+        cacheMisses++;
+        return false;
+    }
+    in >> version >> end >> pageCount;
+    if (version != Version || end > LC3Memory::Size || pageCount > LC3Memory::PageCount)
+    {
+        cacheMisses++;
+        return false;
+    }
+
+    // Read everything before touching the outputs, so a truncated entry is just a miss
+    std::vector<std::pair<quint16, LC3Memory::Page>> pages(pageCount);
+    for (auto &[index, words] : pages)
+    {
+        in >> index;
+        in.readRawData(reinterpret_cast<char *>(words.data()), int(sizeof(words)));
+        qFromLittleEndian<quint16>(words.data(), words.size(), words.data());
+    }
+    AsmSymbolTable cachedLabels;
+    AsmSourceMap cachedMap;
+    in >> cachedLabels >> cachedMap;
+    if (in.status() != QDataStream::Ok)
+    {
+        cacheMisses++;
+        return false;
+    }
+
+    for (const auto &[index, words] : pages)
+        memory.writeBlock(static_cast<uint16_t>((index & (LC3Memory::PageCount - 1)) * LC3Memory::PageSize), words);
+    endAddress = end;
+    labels.insert(cachedLabels);
+    sourceMap = std::move(cachedMap);
+    cacheHits++;
+    return true;
+}
+
+void LC3ImageCache::store(const QByteArray &key, const LC3Memory &memory, uint32_t endAddress, const AsmSymbolTable &labels,
+                          const AsmSourceMap &sourceMap)
+{
+    std::vector<quint16> written;
+    for (std::size_t page = 0; page < LC3Memory::PageCount; ++page)
+    {
+        const uint16_t *words = memory.pageData(page);
+        if (std::any_of(words, words + LC3Memory::PageSize, [](uint16_t word) { return word != 0; }))
+            written.push_back(static_cast<quint16>(page));
+    }
+
+    QByteArray data;
+    QDataStream out(&data, QIODevice::WriteOnly);
+    out.setByteOrder(QDataStream::LittleEndian);
+    out.writeRawData(ImageMagic, sizeof(ImageMagic));
+    out << quint32(Version) << quint32(endAddress) << quint32(written.size());
+    for (quint16 page : written)
+    {
+        std::array<uint16_t, LC3Memory::PageSize> words;
+        qToLittleEndian<quint16>(memory.pageData(page), words.size(), words.data());
+        out << page;
+        out.writeRawData(reinterpret_cast<const char *>(words.data()), int(sizeof(words)));
+    }
+    out << labels << sourceMap;
+
+    QSaveFile file(path(key)); // Readers never see a half-written image
+    if (file.open(QIODevice::WriteOnly))
+    {
+        file.write(data);
+        file.commit();
+    }
+}
@@ -0,0 +1,47 @@
+#ifndef LC3IMAGECACHE_H
+#define LC3IMAGECACHE_H
+
+#include "asmsourcemap.h"
+#include "asmsymbols.h"
+#include "lc3memory.h"
+#include <QByteArray>
+#include <QString>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// On-disk cache of assembled programs keyed by a hash of the source text and
+// AssemblerVersion. A hit gives back the image, the end address, the symbol
+// table and the source map without lexing a single line. Only builds without
+// errors are stored, so a hit never hides a diagnostic.
+class LC3ImageCache
+{
+public:
+    static constexpr uint32_t Version = 3;
+
+    explicit LC3ImageCache(const QString &directory);
+
+    // The source map is finished through origins, so the same expanded text from
+    // other files or lines is another entry; empty for a source with no includes
+    static QByteArray key(std::string_view source, const std::vector<AsmOrigin> &origins = {});
+
+    // Fills memory, endAddress, labels and sourceMap from the entry for key. False
+    // on a miss or an unreadable entry, leaving the outputs untouched.
+    bool lookup(const QByteArray &key, LC3Memory &memory, uint32_t &endAddress, AsmSymbolTable &labels,
+                AsmSourceMap &sourceMap);
+    void store(const QByteArray &key, const LC3Memory &memory, uint32_t endAddress, const AsmSymbolTable &labels,
+               const AsmSourceMap &sourceMap);
+
+    int hits() const { return cacheHits; }
+    int misses() const { return cacheMisses; }
+    double hitRate() const { return cacheHits + cacheMisses ? double(cacheHits) / (cacheHits + cacheMisses) : 0.0; }
+
+private:
+    QString path(const QByteArray &key) const;
+
+    QString directory;
+    int cacheHits = 0;
+    int cacheMisses = 0;
+};
+
+#endif // LC3IMAGECACHE_H
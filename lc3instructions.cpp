@@ -1,8 +1,11 @@
 #include "lc3instructions.h"
+#include "lc3isa.h"
 #include <cstdint>
-#include "Logic.h"
-uint16_t ir, nzp, dr, sr1, imm_flag, sr2, imm5, base_r, flag, opcode, address, v_sr1, v_sr2, GateALU, value, sr;
-int16_t offset9, offset6, offset11;
+
+LC3Instructions::LC3Instructions(LC3Registers &registers, LC3Memory &memory)
+    : registers(registers), memory(memory)
+{
+}
 
 void LC3Instructions::updateFlags(uint16_t result){
     if (result == 0)
@@ -19,7 +22,7 @@ void LC3Instructions::updateFlags(uint16_t result){
     }
 }
 
-void LC3Instructions::fetch(LC3Memory& memory)
+void LC3Instructions::fetch()
 {
     uint16_t pc = registers.getPC();
     registers.setMAR(pc);
@@ -30,206 +33,57 @@ void LC3Instructions::fetch(LC3Memory& memory)
 
 void LC3Instructions::decode()
 {
-    opcode = (registers.getIR() >> 12) & 0xF;
-
-    if (opcode == 0x0)
+    // The fields come from the opcode table the assembler and disassembler use. A
+    // word it does not list (RTI, the reserved opcode, a TRAP other than HALT, a
+    // malformed encoding) disassembles as data and is not executed.
+    ir = registers.getIR();
+    const Lc3InstructionDesc *desc = lc3DecodeWord(ir);
+    if (!desc)
     {
-        // BR instruction
-        ir = registers.getIR();
-        nzp = (ir >> 9) & 0x7; // Extract nzp bits
-        offset9 = ir & 0x1FF; // Extract PCoffset9 (9-bit)
-
-        // Sign-extend offset9 to 16 bits if necessary
-        if (offset9 & 0x100)
-        {
-            offset9 |= 0xFE00; // Sign extend to the left
-        }
+        opcode = NoOpcode;
+        return;
     }
-    else if (opcode == 0x1)
-    {
-        // ADD instruction
-        ir = registers.getIR();
-        dr = (ir >> 9) & 0x7;       // Destination register
-        sr1 = (ir >> 6) & 0x7;      // Source register 1
-        imm_flag = (ir >> 5) & 0x1; // Immediate flag
 
-        if (imm_flag)
+    opcode = (ir >> 12) & 0xF;
+    nzp = (desc->bits >> 9) & 0x7; // BR: the condition codes are part of the mnemonic
+    flag = (ir >> 11) & 0x1;       // JSR rather than JSRR
+    sr1 = 7;                       // RET has no operand; it returns through R7
+    for (std::size_t i = 0; i < desc->operandCount; ++i)
+    {
+        const Lc3OperandField &field = desc->operands[i];
+        switch (field.kind)
         {
-            // Immediate mode
-            imm5 = ir & 0x1F; // Extract immediate value (5 bits)
-
-            // Sign-extend imm5 to 16 bits
-            if (imm5 & 0x10)
-            {
-                imm5 |= 0xFFE0; // Sign extend to the left
-            }
-        }
-        else
-        {
-            // Register mode
-            sr2 = ir & 0x7; // Source register 2
+        case Lc3OperandKind::Register:
+            (field.shift == 9 ? dr : sr1) = (ir >> field.shift) & 0x7; // DR or SR; SR1 or BaseR
+            break;
+        case Lc3OperandKind::RegisterOrImmediate:
+            imm_flag = (ir >> 5) & 0x1;
+            if (imm_flag)
+                imm5 = static_cast<uint16_t>(lc3SignExtend(ir, field.width));
+            else
+                sr2 = ir & 0x7;
+            break;
+        case Lc3OperandKind::SignedImmediate:
+        case Lc3OperandKind::PcOffset:
+            offset = static_cast<int16_t>(lc3SignExtend(ir >> field.shift, field.width));
+            break;
+        default:
+            break;
         }
     }
-    else if (opcode == 0x2)
-    {
-        // LD instruction
-        ir = registers.getIR();
-        dr = (ir >> 9) & 0x0007;
-        offset9 = ir & 0x01FF;
-        if (offset9 & 0x0100) // Sign extension
-        {
-            offset9 |= 0xFE00;
-        }
-    }
-    else if (opcode == 0xA)
-    {
-        // LDI instruction
-        ir = registers.getIR();
-        dr = (ir >> 9) & 0x0007;
-        offset9 = ir & 0x01FF;
-        if (offset9 & 0x0100) // Sign extension
-        {
-            offset9 |= 0xFE00;
-        }
-    }
-    else if (opcode == 0x6)
-    {
-        // LDR instruction
-        ir = registers.getIR();
-        offset6 = ir & 0x003F;
-        if (offset6 & 0x0020) // Sign extension
-        {
-            offset6 |= 0xFFC0;
-        }
-        base_r = (ir >> 6) & 0x0007;
-        dr = (ir >> 9) & 0x0007;
-    }
-    else if (opcode == 0xE)
-    {
-        // LEA instruction
-        ir = registers.getIR();
-        offset9 = ir & 0x1FF;
-        if (offset9 & 0x100)
-        {
-            offset9 |= 0xFE00;
-        }
-
-        dr = (ir >> 9) & 0x0007;
-    }
-    else if (opcode == 0x3)
-    {
-        // ST instruction
-        ir = registers.getIR();
-        dr = (ir >> 9) & 0x7;
-        offset9 = ir & 0x1FF;
-        if (offset9 & 0x0100) // Sign extension
-        {
-            offset9 |= 0xFE00;
-        }
-    }
-    else if (opcode == 0xB)
-    {
-        // STI instruction
-        ir = registers.getIR();
-        dr = (ir >> 9) & 0x7;
-        offset9 = ir & 0x1FF;
-        if (offset9 & 0x0100) // Sign extension
-        {
-            offset9 |= 0xFE00;
-        }
-    }
-    else if (opcode == 0x7)
-    {
-        // STR instruction
-        ir = registers.getIR();
-        dr = (ir >> 9) & 0x7;
-        base_r = (ir >> 6) & 0x7;
-        offset6 = ir & 0x3F;
-        if (offset6 & 0x0020) // Sign extension
-        {
-            offset6 |= 0xFFC0;
-        }
-    }
-    else if (opcode == 0x4)
-    {
-        // JSR or JSRR instruction
-        ir = registers.getIR();
-        flag = (ir >> 11) & 0x1;
-        if (flag)
-        {
-            // JSR
-            offset11 = ir & 0x7FF; // Extract PCoffset11
-            if (offset11 & 0x0400) // Sign extension
-            {
-                offset11 |= 0xF800;
-            }
-        }
-        else
-        {
-            // JSRR
-            base_r = (ir >> 6) & 0x7;
-        }
-    }
-    else if (opcode == 0x5)
-    {
-        // AND instruction
-        ir = registers.getIR();
-        dr = (ir >> 9) & 0x7;
-        sr1 = (ir >> 6) & 0x7;
-        imm_flag = (ir >> 5) & 0x1;
-
-        if (imm_flag)
-        {
-            // Immediate mode
-            imm5 = ir & 0x1F;
-
-            // Sign-extend imm5 to 16 bits
-            if (imm5 & 0x10)
-            {
-                imm5 |= 0xFFE0; // Sign extend to the left
-            }
-        }
-        else
-        {
-            // Register mode
-            sr2 = ir & 0x7; // Source register 2
-        }
-    }
-    else if (opcode == 0xC)
-    {
-        // RET or JMP instruction
-        ir = registers.getIR();
-        if (((ir >> 6) & 0x7) == 7)
-        {
-            // RET
-            address = registers.getR(7); // Set PC to the value contained in R7
-        }
-        else
-        {
-            // JMP
-            base_r = (ir >> 6) & 0x7;
-        }
-    }
-    else if (opcode == 0x9)
-    {
-        // NOT instruction
-        ir = registers.getIR();
-        dr = (ir >> 9) & 0x7; // Destination register
-        sr = (ir >> 6) & 0x7; // Source register
-    }
 }
 
-void LC3Instructions::evaluateAddress(LC3Memory &memory)
+void LC3Instructions::evaluateAddress()
 {
     if (opcode == 0x0)
     {
         // BR instruction
-        address = registers.getPC() + offset9;
+        address = registers.getPC() + offset;
     }
     else if (opcode == 0x2)
     {
         // LD instruction
-        address = registers.getPC() + offset9;
+        address = registers.getPC() + offset;
         registers.setMAR(address); // Set the address in MAR
     }
     else if (opcode == 0x4)
@@ -237,18 +91,18 @@ void LC3Instructions::evaluateAddress(LC3Memory &memory)
         // JSR instruction
         if (flag)
         {
-            address = registers.getPC() + offset11; // Update PC with the offset
+            address = registers.getPC() + offset; // Update PC with the offset
         }
         else
         {
             // JSRR instruction
-            address = registers.getR(base_r);
+            address = registers.getR(sr1);
         }
     }
     else if (opcode == 0xA)
     {
         // LDI instruction
-        address = registers.getPC() + offset9;
+        address = registers.getPC() + offset;
         registers.setMAR(address);
         address = memory.read(registers.getMAR());
         registers.setMAR(address);
@@ -256,46 +110,37 @@ void LC3Instructions::evaluateAddress(LC3Memory &memory)
     else if (opcode == 0x6)
     {
         // LDR instruction
-        address = registers.getR(base_r) + offset6;
+        address = registers.getR(sr1) + offset;
         registers.setMAR(address);
     }
     else if (opcode == 0xC)
     {
-        // RET or JMP instruction
-        if (((registers.getIR() >> 6) & 0x7) == 7)
-        {
-            // RET
-            address = registers.getR(7); // Set PC to the value contained in R7
-        }
-        else
-        {
-            // JMP
-            address = registers.getR(base_r);
-        }
+        // JMP, or RET through R7
+        address = registers.getR(sr1);
     }
     else if (opcode == 0xE)
     {
         // LEA instruction
-        address = registers.getPC() + offset9;
+        address = registers.getPC() + offset;
     }
     else if (opcode == 0x3)
     {
         // ST instruction
-        address = registers.getPC() + offset9;
+        address = registers.getPC() + offset;
     }
     else if (opcode == 0xB)
     {
         // STI instruction
-        address = registers.getPC() + offset9;
+        address = registers.getPC() + offset;
     }
     else if (opcode == 0x7)
     {
         // STR instruction
-        address = registers.getR(base_r) + offset6;
+        address = registers.getR(sr1) + offset;
     }
 }
 
-void LC3Instructions::fetchOperands(LC3Memory &memory)
+void LC3Instructions::fetchOperands()
 {
     if (opcode == 0x1)
     {
@@ -312,7 +157,7 @@ void LC3Instructions::fetchOperands(LC3Memory &memory)
     else if (opcode == 0x9)
     {
         // NOT instruction
-        v_sr1 = registers.getR(sr);
+        v_sr1 = registers.getR(sr1);
     }
     else if (opcode == 0x2)
     {
@@ -348,8 +193,6 @@ void LC3Instructions::fetchOperands(LC3Memory &memory)
 
 void LC3Instructions::execute()
 {
-    uint16_t opcode = (registers.getIR() >> 12) & 0xF;
-
     if (opcode == 0x1)
     {
         // ADD instruction
@@ -385,7 +228,7 @@ void LC3Instructions::execute()
     }
 }
 
-void LC3Instructions::store(LC3Memory &memory)
+void LC3Instructions::store()
 {
     if (opcode == 0x0)
     { // BR instruction
@@ -505,7 +348,8 @@ void LC3Instructions::store(LC3Memory &memory)
     }
 }
 
-bool LC3Instructions::isHalt(){
+bool LC3Instructions::isHalt() const
+{
     return (registers.getMDR() == 0xF025);
 }
 
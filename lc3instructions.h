@@ -3,24 +3,37 @@
 
 #include "lc3registers.h"
 #include "lc3memory.h"
+#include <cstdint>
 
-
-
+// The LC3 instruction cycle, one phase per call, on the registers and memory it
+// is bound to. The simulator shows each phase as it runs; LC3Machine runs all
+// six for a step, so both execute instructions the same way. TRAP does nothing
+// here: the caller decides what a trap does, and isHalt() spots HALT on fetch.
 class LC3Instructions
 {
 public:
+    LC3Instructions(LC3Registers &registers, LC3Memory &memory);
+
+    void fetch();
+    void decode();
+    void evaluateAddress();
+    void fetchOperands();
+    void execute();
+    void store();
+    bool isHalt() const; // The word just fetched is HALT (TRAP x25)
 
-    static void fetch( LC3Memory& memory);
-    static void decode();
-    static void  evaluateAddress( LC3Memory& memory);
-    static void fetchOperands(LC3Memory& memory);
-    static void execute();
-    static void  store(LC3Memory &memory);
-    static void updateFlags(uint16_t result);
-    static bool isHalt();
+private:
+    void updateFlags(uint16_t result);
 
+    LC3Registers &registers;
+    LC3Memory &memory;
 
+    static constexpr uint16_t NoOpcode = 0xFFFF; // Decoded as no instruction; no phase acts on it
 
+    // Latched between phases of the current instruction
+    uint16_t ir = 0, nzp = 0, dr = 0, sr1 = 0, imm_flag = 0, sr2 = 0, imm5 = 0, flag = 0, opcode = 0;
+    uint16_t address = 0, v_sr1 = 0, v_sr2 = 0, GateALU = 0, value = 0;
+    int16_t offset = 0; // PCoffset9, PCoffset11 or offset6
 };
 
 #endif // LC3INSTRUCTIONS_H
@@ -0,0 +1,41 @@
+#include "lc3isa.h"
+#include <cstdio>
+
+std::string lc3Disassemble(uint16_t word, uint16_t address)
+{
+    char buffer[16];
+    const Lc3InstructionDesc *desc = lc3DecodeWord(word);
+    if (!desc) {
+        std::snprintf(buffer, sizeof(buffer), "HEX 0x%04X", word);
+        return buffer;
+    }
+
+    std::string text(desc->mnemonic);
+    for (std::size_t i = 0; i < desc->operandCount; ++i) {
+        const Lc3OperandField &field = desc->operands[i];
+        text += i == 0 ? " " : ", ";
+        switch (field.kind) {
+        case Lc3OperandKind::Register:
+            std::snprintf(buffer, sizeof(buffer), "R%d", (word >> field.shift) & 0x7);
+            break;
+        case Lc3OperandKind::RegisterOrImmediate:
+            if (word & 0x20)
+                std::snprintf(buffer, sizeof(buffer), "#%d", lc3SignExtend(word, field.width));
+            else
+                std::snprintf(buffer, sizeof(buffer), "R%d", word & 0x7);
+            break;
+        case Lc3OperandKind::SignedImmediate:
+            std::snprintf(buffer, sizeof(buffer), "#%d", lc3SignExtend(word >> field.shift, field.width));
+            break;
+        case Lc3OperandKind::PcOffset:
+            std::snprintf(buffer, sizeof(buffer), "x%04X",
+                          static_cast<uint16_t>(address + 1 + lc3SignExtend(word, field.width)));
+            break;
+        default:
+            buffer[0] = '\0';
+            break;
+        }
+        text += buffer;
+    }
+    return text;
+}
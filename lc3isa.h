@@ -0,0 +1,293 @@
+#ifndef LC3ISA_H
+#define LC3ISA_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// One table describes every mnemonic the assembler knows: its fixed bits, its
+// operands and where they go. The validator, the encoder and the disassembler are
+// all driven by it, and mnemonics are found through a perfect hash built at
+// compile time.
+
+enum class Lc3OperandKind : uint8_t
+{
+    None,
+    Register,            // R0 - R7, 3 bits at shift
+    RegisterOrImmediate, // SR2 in bits 2-0, or bit 5 set and a signed immediate of width bits
+    SignedImmediate,     // #n, two's complement in width bits at shift
+    PcOffset,            // Label, stored as a signed offset from the next instruction
+    DecimalWord,         // Whole 16-bit data word written in decimal (signed or unsigned)
+    HexWord,             // Whole 16-bit data word written in hex
+    UnsignedDecimal,     // Unsigned decimal that must fit width bits
+    AnyWord,             // Whole 16-bit data word as #n, xN or n
+    Symbol,              // Label name, for linkage directives
+    Text                 // Quoted string or file name, for block directives
+};
+
+enum class Lc3EntryKind : uint8_t
+{
+    Instruction,
+    Data, // Emits its operand as a data word
+    Block,  // Emits a run of words (.BLKW, .STRINGZ, .INCBIN); see expandBlockDirective()
+    Org,    // ORG address
+    End,    // END
+    Export, // EXPORT label: visible to other modules at link time
+    Import  // IMPORT label: defined by another module
+};
+
+struct Lc3OperandField
+{
+    Lc3OperandKind kind = Lc3OperandKind::None;
+    uint8_t shift = 0;
+    uint8_t width = 0;
+};
+
+struct Lc3InstructionDesc
+{
+    std::string_view mnemonic;
+    Lc3EntryKind kind;
+    uint16_t bits; // Fixed bits of the encoding
+    uint16_t mask; // Bits that identify the instruction when decoding
+    uint8_t operandCount;
+    std::array<Lc3OperandField, 3> operands;
+};
+
+namespace lc3isa_detail {
+constexpr Lc3OperandField reg(uint8_t shift) { return {Lc3OperandKind::Register, shift, 3}; }
+constexpr Lc3OperandField regOrImm5() { return {Lc3OperandKind::RegisterOrImmediate, 0, 5}; }
+constexpr Lc3OperandField simm(uint8_t width) { return {Lc3OperandKind::SignedImmediate, 0, width}; }
+constexpr Lc3OperandField pcOffset(uint8_t width) { return {Lc3OperandKind::PcOffset, 0, width}; }
+constexpr Lc3OperandField word(Lc3OperandKind kind, uint8_t width = 16) { return {kind, 0, width}; }
+constexpr Lc3OperandField none() { return {}; }
+constexpr Lc3InstructionDesc op(std::string_view mnemonic, uint16_t bits, uint16_t mask, uint8_t count,
+                                Lc3OperandField a = none(), Lc3OperandField b = none(), Lc3OperandField c = none())
+{
+    return {mnemonic, Lc3EntryKind::Instruction, bits, mask, count, {a, b, c}};
+}
+constexpr Lc3InstructionDesc data(std::string_view mnemonic, Lc3OperandField value)
+{
+    return {mnemonic, Lc3EntryKind::Data, 0, 0, 1, {value, none(), none()}};
+}
+} // namespace lc3isa_detail
+
+inline constexpr auto Lc3InstructionTable = [] {
+    using namespace lc3isa_detail;
+    using K = Lc3OperandKind;
+    // Decoding takes the first entry whose mask matches, so exact encodings
+    // (RET, HALT) come before the general forms they overlap (JMP).
+    return std::array{
+        op("ADD",   0x1000, 0xF000, 3, reg(9), reg(6), regOrImm5()),
+        op("AND",   0x5000, 0xF000, 3, reg(9), reg(6), regOrImm5()),
+        op("BRnzp", 0x0E00, 0xFE00, 1, pcOffset(9)),
+        op("BR",    0x0E00, 0xFE00, 1, pcOffset(9)), // BR is BRnzp; listed second so BRnzp disassembles
+        op("BRn",   0x0800, 0xFE00, 1, pcOffset(9)),
+        op("BRz",   0x0400, 0xFE00, 1, pcOffset(9)),
+        op("BRp",   0x0200, 0xFE00, 1, pcOffset(9)),
+        op("BRnz",  0x0C00, 0xFE00, 1, pcOffset(9)),
+        op("BRnp",  0x0A00, 0xFE00, 1, pcOffset(9)),
+        op("BRzp",  0x0600, 0xFE00, 1, pcOffset(9)),
+        op("RET",   0xC1C0, 0xFFFF, 0),
+        op("JMP",   0xC000, 0xFE3F, 1, reg(6)),
+        op("JSR",   0x4800, 0xF800, 1, pcOffset(11)),
+        op("JSRR",  0x4000, 0xFE3F, 1, reg(6)),
+        op("LD",    0x2000, 0xF000, 2, reg(9), pcOffset(9)),
+        op("LDI",   0xA000, 0xF000, 2, reg(9), pcOffset(9)),
+        op("LDR",   0x6000, 0xF000, 3, reg(9), reg(6), simm(6)),
+        op("LEA",   0xE000, 0xF000, 2, reg(9), pcOffset(9)),
+        op("NOT",   0x903F, 0xF03F, 2, reg(9), reg(6)),
+        op("ST",    0x3000, 0xF000, 2, reg(9), pcOffset(9)),
+        op("STI",   0xB000, 0xF000, 2, reg(9), pcOffset(9)),
+        op("STR",   0x7000, 0xF000, 3, reg(9), reg(6), simm(6)),
+        op("HALT",  0xF025, 0xFFFF, 0),
+        data("DEC",  word(K::DecimalWord)),
+        data("HEX",  word(K::HexWord)),
+        data("WORD", word(K::UnsignedDecimal, 16)),
+        data("BYTE", word(K::UnsignedDecimal, 8)),
+        data(".FILL", word(K::AnyWord)),
+        Lc3InstructionDesc{".BLKW", Lc3EntryKind::Block, 0, 0, 2, {word(K::AnyWord), word(K::AnyWord), none()}}, // Value is optional
+        Lc3InstructionDesc{".STRINGZ", Lc3EntryKind::Block, 0, 0, 1, {word(K::Text), none(), none()}},
+        Lc3InstructionDesc{".INCBIN", Lc3EntryKind::Block, 0, 0, 1, {word(K::Text), none(), none()}},
+        Lc3InstructionDesc{"ORG", Lc3EntryKind::Org, 0, 0, 1, {word(K::HexWord), none(), none()}},
+        Lc3InstructionDesc{"END", Lc3EntryKind::End, 0, 0, 0, {}},
+        Lc3InstructionDesc{"EXPORT", Lc3EntryKind::Export, 0, 0, 1, {word(K::Symbol), none(), none()}},
+        Lc3InstructionDesc{"IMPORT", Lc3EntryKind::Import, 0, 0, 1, {word(K::Symbol), none(), none()}},
+    };
+}();
+
+namespace lc3isa_detail {
+
+inline constexpr std::size_t HashSlots = 128;
+inline constexpr uint8_t EmptySlot = 0xFF;
+
+constexpr std::size_t hashMnemonic(std::string_view text, uint32_t seed)
+{
+    uint32_t hash = 2166136261u ^ seed; // FNV-1a
+    for (char ch : text) {
+        hash ^= static_cast<uint8_t>(ch);
+        hash *= 16777619u;
+    }
+    return (hash ^ (hash >> 15)) & (HashSlots - 1);
+}
+
+struct PerfectHash
+{
+    uint32_t seed = 0;
+    std::array<uint8_t, HashSlots> slots{};
+};
+
+// Tries seeds until every mnemonic lands in its own slot. Gives up with seed 0
+// if none of the first MaxSeed does; the static_assert below then fails.
+inline constexpr uint32_t MaxSeed = 4096;
+
+constexpr PerfectHash buildPerfectHash()
+{
+    for (uint32_t seed = 1; seed < MaxSeed; ++seed) {
+        PerfectHash result;
+        result.seed = seed;
+        result.slots.fill(EmptySlot);
+        bool collision = false;
+        for (std::size_t i = 0; i < Lc3InstructionTable.size() && !collision; ++i) {
+            std::size_t slot = hashMnemonic(Lc3InstructionTable[i].mnemonic, seed);
+            collision = result.slots[slot] != EmptySlot;
+            result.slots[slot] = static_cast<uint8_t>(i);
+        }
+        if (!collision)
+            return result;
+    }
+    return PerfectHash{};
+}
+
+inline constexpr PerfectHash MnemonicHash = buildPerfectHash();
+
+// Each mnemonic hashes to the slot that holds it, so no two share a slot
+constexpr bool isCollisionFree(const PerfectHash &hash)
+{
+    for (std::size_t i = 0; i < Lc3InstructionTable.size(); ++i) {
+        if (hash.slots[hashMnemonic(Lc3InstructionTable[i].mnemonic, hash.seed)] != i)
+            return false;
+    }
+    return hash.seed != 0;
+}
+
+static_assert(Lc3InstructionTable.size() < EmptySlot && Lc3InstructionTable.size() <= HashSlots);
+static_assert(isCollisionFree(MnemonicHash), "No seed gives every mnemonic its own slot; raise HashSlots");
+
+// Table entries grouped by the top four opcode bits, in table order
+struct DecodeIndex
+{
+    std::array<std::array<uint8_t, 12>, 16> entries{};
+    std::array<uint8_t, 16> counts{};
+};
+
+constexpr DecodeIndex buildDecodeIndex()
+{
+    DecodeIndex index;
+    for (std::size_t i = 0; i < Lc3InstructionTable.size(); ++i) {
+        const Lc3InstructionDesc &desc = Lc3InstructionTable[i];
+        if (desc.kind != Lc3EntryKind::Instruction)
+            continue;
+        std::size_t opcode = desc.bits >> 12;
+        index.entries[opcode][index.counts[opcode]++] = static_cast<uint8_t>(i);
+    }
+    return index;
+}
+
+inline constexpr DecodeIndex OpcodeIndex = buildDecodeIndex();
+
+constexpr const Lc3InstructionDesc *findExact(std::string_view mnemonic)
+{
+    uint8_t index = MnemonicHash.slots[hashMnemonic(mnemonic, MnemonicHash.seed)];
+    if (index == EmptySlot || Lc3InstructionTable[index].mnemonic != mnemonic)
+        return nullptr;
+    return &Lc3InstructionTable[index];
+}
+
+// Writes a BR mnemonic with its condition flags in table order ("BRpz" becomes
+// "BRzp"). False unless mnemonic is BR followed by n, z and p, each at most once.
+constexpr bool canonicalBranch(std::string_view mnemonic, std::array<char, 5> &canonical, std::size_t &length)
+{
+    if (mnemonic.size() < 3 || mnemonic.size() > canonical.size() || mnemonic.substr(0, 2) != "BR")
+        return false;
+    bool n = false, z = false, p = false;
+    for (char ch : mnemonic.substr(2)) {
+        bool *flag = ch == 'n' ? &n : ch == 'z' ? &z : ch == 'p' ? &p : nullptr;
+        if (!flag || *flag)
+            return false;
+        *flag = true;
+    }
+    length = 0;
+    canonical[length++] = 'B';
+    canonical[length++] = 'R';
+    if (n)
+        canonical[length++] = 'n';
+    if (z)
+        canonical[length++] = 'z';
+    if (p)
+        canonical[length++] = 'p';
+    return true;
+}
+
+} // namespace lc3isa_detail
+
+// O(1): one hash and one string compare. The table lists each BR condition once,
+// with its flags in n, z, p order; any other order takes a second lookup, so
+// sources written as BRpz or BRzn still assemble.
+constexpr const Lc3InstructionDesc *lc3FindMnemonic(std::string_view mnemonic)
+{
+    using namespace lc3isa_detail;
+    if (const Lc3InstructionDesc *desc = findExact(mnemonic))
+        return desc;
+    std::array<char, 5> canonical{};
+    std::size_t length = 0;
+    if (canonicalBranch(mnemonic, canonical, length))
+        return findExact(std::string_view(canonical.data(), length));
+    return nullptr;
+}
+
+// The instruction a machine word encodes, or nullptr for words that are not valid
+// instructions in this table (NOP, RTI, reserved opcodes, other TRAPs)
+constexpr const Lc3InstructionDesc *lc3DecodeWord(uint16_t word)
+{
+    using namespace lc3isa_detail;
+    std::size_t opcode = word >> 12;
+    for (std::size_t i = 0; i < OpcodeIndex.counts[opcode]; ++i) {
+        const Lc3InstructionDesc &desc = Lc3InstructionTable[OpcodeIndex.entries[opcode][i]];
+        if ((word & desc.mask) == desc.bits)
+            return &desc;
+    }
+    return nullptr;
+}
+
+constexpr int lc3SignExtend(uint16_t value, int bits)
+{
+    int field = value & ((1 << bits) - 1);
+    return (field & (1 << (bits - 1))) ? field - (1 << bits) : field;
+}
+
+// Packs value into a bits-wide two's complement field; false if it does not fit
+constexpr bool lc3SignedField(int value, int bits, uint16_t &field)
+{
+    int limit = 1 << (bits - 1);
+    if (value < -limit || value >= limit)
+        return false;
+    field = static_cast<uint16_t>(value) & ((1u << bits) - 1);
+    return true;
+}
+
+static_assert(lc3FindMnemonic("ADD")->bits == 0x1000);
+static_assert(lc3FindMnemonic("BRnzp")->bits == 0x0E00 && lc3FindMnemonic("HALT")->bits == 0xF025);
+static_assert(lc3FindMnemonic("FOO") == nullptr);
+static_assert(lc3FindMnemonic("BRpz") == lc3FindMnemonic("BRzp") && lc3FindMnemonic("BRzn")->bits == 0x0C00);
+static_assert(lc3FindMnemonic("BRpzn")->bits == 0x0E00 && lc3FindMnemonic("BRpn")->bits == 0x0A00);
+static_assert(lc3FindMnemonic("BRnn") == nullptr && lc3FindMnemonic("BRx") == nullptr);
+static_assert(lc3FindMnemonic(".BLKW")->kind == Lc3EntryKind::Block);
+static_assert(lc3DecodeWord(0xC1C0)->mnemonic == std::string_view("RET"));
+static_assert(lc3DecodeWord(0xC080)->mnemonic == std::string_view("JMP"));
+
+// "ADD R1, R1, #-3", "BRn x3004"; words that are not instructions come out as HEX data
+std::string lc3Disassemble(uint16_t word, uint16_t address);
+
+#endif // LC3ISA_H
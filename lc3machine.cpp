@@ -0,0 +1,58 @@
+#include "lc3machine.h"
+
+static constexpr uint8_t HaltVector = 0x25;
+
+LC3Machine::LC3Machine()
+    : mem(LC3Memory::Layout::Flat), cpu(regs, mem)
+{
+}
+
+void LC3Machine::reset()
+{
+    regs = LC3Registers();
+    mem.clear();
+}
+
+void LC3Machine::setBreakpoint(uint16_t address, bool enabled)
+{
+    uint64_t bit = uint64_t(1) << (address & 63);
+    if (enabled)
+        breakpoints[address >> 6] |= bit;
+    else
+        breakpoints[address >> 6] &= ~bit;
+}
+
+LC3Machine::Status LC3Machine::step()
+{
+    cpu.fetch();
+    uint16_t ir = regs.getIR();
+    if ((ir >> 12) == 0xF) // TRAP, which LC3Instructions leaves to its caller
+    {
+        uint8_t vector = ir & 0xFF;
+        if (trapHandler && trapHandler(*this, vector))
+            return Status::Running;
+        regs.setPC(regs.getPC() - 1);
+        return vector == HaltVector ? Status::Halted : Status::UnhandledTrap;
+    }
+    cpu.decode();
+    cpu.evaluateAddress();
+    cpu.fetchOperands();
+    cpu.execute();
+    cpu.store();
+    return Status::Running;
+}
+
+LC3Machine::Status LC3Machine::run(uint64_t budget, uint64_t &executed)
+{
+    executed = 0;
+    while (executed < budget)
+    {
+        if (executed > 0 && hasBreakpoint(regs.getPC()))
+            return Status::Breakpoint;
+        Status status = step();
+        if (status != Status::Running)
+            return status;
+        ++executed;
+    }
+    return Status::Running;
+}
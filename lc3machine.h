@@ -0,0 +1,59 @@
+#ifndef LC3MACHINE_H
+#define LC3MACHINE_H
+
+#include "lc3instructions.h"
+#include "lc3memory.h"
+#include "lc3registers.h"
+#include <array>
+#include <cstdint>
+#include <functional>
+
+// A complete LC3 that runs whole instructions, with no UI and no globals, so any
+// number of machines can run side by side (one thread each). A step runs the six
+// LC3Instructions phases the simulator steps through one at a time, so both
+// execute every instruction the same way. TRAPs go to the trap handler, and HALT
+// (TRAP x25) stops the machine if the handler does not take it.
+class LC3Machine
+{
+public:
+    enum class Status { Running, Halted, Breakpoint, UnhandledTrap };
+
+    // Returns true if it handled the TRAP; it may read and change the machine.
+    // On false, HALT stops the machine and any other vector is unhandled.
+    using TrapHandler = std::function<bool(LC3Machine &machine, uint8_t vector)>;
+
+    LC3Machine();
+
+    LC3Registers &registers() { return regs; }
+    const LC3Registers &registers() const { return regs; }
+    LC3Memory &memory() { return mem; }
+    const LC3Memory &memory() const { return mem; }
+
+    // Zeroes the registers and memory; breakpoints and the trap handler stay
+    void reset();
+
+    // Executes the instruction at PC, ignoring breakpoints. A HALT or unhandled
+    // TRAP leaves PC on the TRAP, so stepping again stops again.
+    Status step();
+
+    // Runs until budget instructions have executed (Running), the machine halts,
+    // an unhandled TRAP, or PC reaches a breakpoint. The instruction at PC when
+    // run() starts is executed even if it has a breakpoint, so a run can resume
+    // from one. executed counts the instructions completed.
+    Status run(uint64_t budget, uint64_t &executed);
+
+    void setBreakpoint(uint16_t address, bool enabled);
+    bool hasBreakpoint(uint16_t address) const { return (breakpoints[address >> 6] >> (address & 63)) & 1; }
+    void clearBreakpoints() { breakpoints.fill(0); }
+
+    void setTrapHandler(TrapHandler handler) { trapHandler = std::move(handler); }
+
+private:
+    LC3Registers regs;
+    LC3Memory mem;
+    LC3Instructions cpu; // Bound to regs and mem
+    std::array<uint64_t, LC3Memory::Size / 64> breakpoints{};
+    TrapHandler trapHandler;
+};
+
+#endif // LC3MACHINE_H
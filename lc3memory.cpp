@@ -1,26 +1,324 @@
 #include "lc3memory.h"
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstring>
 
 
-LC3Memory::LC3Memory(uint16_t size)
+LC3Memory::LC3Memory(Layout layout)
+    : memoryMode(layout == Layout::Paged ? Mode::Paged : Mode::Flat)
 {
-    memory.resize(size);
+    if (memoryMode == Mode::Paged)
+        pages.fill(zeroPage());
+    else
+        allocateFlat();
 }
 
-uint16_t LC3Memory::read(uint16_t address) const
+void LC3Memory::allocateFlat()
 {
-    if (address < memory.size()) {
-        return memory[address];
-    } else {
-        // Handle error or throw exception
-        return 0;
+    // One zeroed block; every page is an aliasing view into it
+    std::shared_ptr<Page[]> block(new Page[PageCount]());
+    for (std::size_t page = 0; page < PageCount; ++page) {
+        pages[page] = std::shared_ptr<Page>(block, &block[page]);
+    }
+    privatePages.fill(~uint64_t(0));
+    words = block[0].data();
+}
+
+void LC3Memory::attachExternal(uint16_t *buffer, uint64_t *writeSequence)
+{
+    Page *external = reinterpret_cast<Page *>(buffer);
+    for (std::size_t page = 0; page < PageCount; ++page) {
+        pages[page] = std::shared_ptr<Page>(std::shared_ptr<Page>(), &external[page]); // Non-owning
+    }
+    privatePages.fill(~uint64_t(0));
+    dirty.fill(~uint64_t(0));
+    sequence = writeSequence;
+    words = buffer;
+    memoryMode = Mode::External;
+}
+
+void LC3Memory::detachExternal()
+{
+    if (memoryMode != Mode::External)
+        return;
+
+    std::array<std::shared_ptr<Page>, PageCount> external = pages;
+    allocateFlat();
+    for (std::size_t page = 0; page < PageCount; ++page) {
+        *pages[page] = *external[page];
+    }
+    sequence = nullptr;
+    memoryMode = Mode::Flat;
+}
+
+// Seqlock writer side. The counter lives in shared memory, so it is accessed
+// through std::atomic_ref rather than being a std::atomic member.
+void LC3Memory::beginSequencedWrite()
+{
+    if (sequence) {
+        std::atomic_ref<uint64_t>(*sequence).fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+}
+
+void LC3Memory::endSequencedWrite()
+{
+    if (sequence) {
+        std::atomic_ref<uint64_t>(*sequence).fetch_add(1, std::memory_order_release);
+    }
+}
+
+void LC3Memory::writeSequenced(std::size_t page, uint16_t address, uint16_t value)
+{
+    beginSequencedWrite();
+    words[address] = value;
+    endSequencedWrite();
+    markDirty(page);
+}
+
+const std::shared_ptr<LC3Memory::Page> &LC3Memory::zeroPage()
+{
+    // Never written: pages pointing here are never marked private
+    static const std::shared_ptr<Page> zero = std::make_shared<Page>();
+    return zero;
+}
+
+std::size_t LC3Memory::clip(uint16_t start, std::size_t count)
+{
+    return std::min(count, Size - start);
+}
+
+void LC3Memory::makePagePrivate(std::size_t page, bool keepContents)
+{
+    std::shared_ptr<Page> copy = std::make_shared_for_overwrite<Page>();
+    if (keepContents) {
+        *copy = *pages[page];
+    }
+    pages[page] = std::move(copy);
+    setBit(privatePages, page);
+}
+
+void LC3Memory::sharePage(std::size_t page, std::shared_ptr<Page> data)
+{
+    pages[page] = std::move(data);
+    clearBit(privatePages, page);
+}
+
+void LC3Memory::markDirty(uint16_t start, std::size_t count)
+{
+    if (count == 0)
+        return;
+    std::size_t last = (start + count - 1) >> PageBits;
+    for (std::size_t page = start >> PageBits; page <= last; ++page) {
+        markDirty(page);
+    }
+}
+
+std::size_t LC3Memory::readBlock(uint16_t start, std::span<uint16_t> out) const
+{
+    std::size_t count = clip(start, out.size());
+    std::size_t done = 0;
+    while (done < count) {
+        std::size_t address = start + done;
+        std::size_t offset = address & PageMask;
+        std::size_t chunk = std::min(count - done, PageSize - offset);
+        std::memcpy(out.data() + done, pages[address >> PageBits]->data() + offset, chunk * sizeof(uint16_t));
+        done += chunk;
+    }
+    return count;
+}
+
+std::size_t LC3Memory::writeBlock(uint16_t start, std::span<const uint16_t> data)
+{
+    std::size_t count = clip(start, data.size());
+    std::size_t done = 0;
+    beginSequencedWrite();
+    while (done < count) {
+        std::size_t address = start + done;
+        std::size_t page = address >> PageBits;
+        std::size_t offset = address & PageMask;
+        std::size_t chunk = std::min(count - done, PageSize - offset);
+        if (!isPagePrivate(page)) {
+            makePagePrivate(page, chunk != PageSize); // A full-page write needs no copy
+        }
+        std::memcpy(pages[page]->data() + offset, data.data() + done, chunk * sizeof(uint16_t));
+        done += chunk;
     }
+    endSequencedWrite();
+    markDirty(start, count);
+    return count;
 }
 
-void LC3Memory::write(uint16_t address, uint16_t value)
+std::size_t LC3Memory::fill(uint16_t start, std::size_t count, uint16_t value)
 {
-    if (address < memory.size()) {
-        memory[address] = value;
+    count = clip(start, count);
+    std::size_t done = 0;
+    beginSequencedWrite();
+    while (done < count) {
+        std::size_t address = start + done;
+        std::size_t page = address >> PageBits;
+        std::size_t offset = address & PageMask;
+        std::size_t chunk = std::min(count - done, PageSize - offset);
+        if (memoryMode == Mode::Paged && value == 0 && chunk == PageSize) {
+            sharePage(page, zeroPage()); // Zeroing a whole page releases it
+        } else {
+            if (!isPagePrivate(page)) {
+                makePagePrivate(page, chunk != PageSize);
+            }
+            std::fill_n(pages[page]->data() + offset, chunk, value);
+        }
+        done += chunk;
+    }
+    endSequencedWrite();
+    markDirty(start, count);
+    return count;
+}
+
+std::size_t LC3Memory::copy(uint16_t destination, uint16_t source, std::size_t count)
+{
+    count = std::min(clip(destination, count), clip(source, count));
+    // Source and destination may overlap and need not share page alignment
+    std::vector<uint16_t> buffer(count);
+    readBlock(source, buffer);
+    return writeBlock(destination, buffer);
+}
+
+void LC3Memory::clear()
+{
+    if (memoryMode == Mode::Paged) {
+        pages.fill(zeroPage());
+        privatePages.fill(0);
     } else {
-        // Handle error or throw exception
+        beginSequencedWrite();
+        for (const std::shared_ptr<Page> &page : pages) {
+            page->fill(0);
+        }
+        endSequencedWrite();
+    }
+    dirty.fill(~uint64_t(0));
+}
+
+void LC3Memory::loadImage(const LC3MemoryImage &image)
+{
+    beginSequencedWrite();
+    for (std::size_t page = 0; page < PageCount; ++page) {
+        const std::shared_ptr<Page> &source = image.page(page);
+        if (memoryMode == Mode::Paged) {
+            sharePage(page, source ? source : zeroPage());
+        } else if (source) {
+            *pages[page] = *source;
+        } else {
+            pages[page]->fill(0);
+        }
+    }
+    endSequencedWrite();
+    dirty.fill(~uint64_t(0));
+}
+
+std::size_t LC3Memory::privatePageCount() const
+{
+    std::size_t count = 0;
+    for (uint64_t bits : privatePages) {
+        count += std::popcount(bits);
+    }
+    return count;
+}
+
+bool LC3Memory::hasDirtyPages() const
+{
+    return std::any_of(dirty.begin(), dirty.end(), [](uint64_t bits) { return bits != 0; });
+}
+
+std::vector<LC3MemoryRange> LC3Memory::dirtyRanges() const
+{
+    std::vector<LC3MemoryRange> ranges;
+    std::size_t page = 0;
+    while (page < PageCount) {
+        if (!isPageDirty(page)) {
+            ++page;
+            continue;
+        }
+        std::size_t first = page;
+        while (page < PageCount && isPageDirty(page)) {
+            ++page;
+        }
+        ranges.push_back({static_cast<uint16_t>(first << PageBits),
+                          static_cast<uint32_t>((page - first) << PageBits)});
+    }
+    return ranges;
+}
+
+void LC3Memory::addObserver(LC3MemoryObserver *observer)
+{
+    if (std::find(observers.begin(), observers.end(), observer) == observers.end()) {
+        observers.push_back(observer);
+    }
+}
+
+void LC3Memory::removeObserver(LC3MemoryObserver *observer)
+{
+    observers.erase(std::remove(observers.begin(), observers.end(), observer), observers.end());
+}
+
+void LC3Memory::publishChanges()
+{
+    if (!hasDirtyPages())
+        return;
+
+    std::vector<LC3MemoryRange> ranges = dirtyRanges();
+    clearDirty();
+    for (LC3MemoryObserver *observer : observers) {
+        observer->memoryChanged(ranges);
+    }
+}
+
+LC3MemoryImage::LC3MemoryImage() = default;
+
+LC3MemoryImage LC3MemoryImage::capture(const LC3Memory &memory)
+{
+    return capture(memory, LC3MemoryImage());
+}
+
+LC3MemoryImage LC3MemoryImage::capture(const LC3Memory &memory, const LC3MemoryImage &base)
+{
+    LC3MemoryImage image;
+    for (std::size_t page = 0; page < LC3Memory::PageCount; ++page) {
+        if (!memory.isPagePrivate(page)) {
+            // Already immutable: share it as is
+            if (memory.pages[page] != LC3Memory::zeroPage())
+                image.pages[page] = memory.pages[page];
+            continue;
+        }
+        const uint16_t *words = memory.pageData(page);
+        if (std::all_of(words, words + LC3Memory::PageSize, [](uint16_t word) { return word == 0; }))
+            continue;
+        const std::shared_ptr<LC3Memory::Page> &previous = base.pages[page];
+        if (previous && std::memcmp(previous->data(), words, sizeof(LC3Memory::Page)) == 0) {
+            image.pages[page] = previous;
+            continue;
+        }
+        auto copy = std::make_shared_for_overwrite<LC3Memory::Page>();
+        std::memcpy(copy->data(), words, sizeof(LC3Memory::Page));
+        image.pages[page] = std::move(copy);
+    }
+    return image;
+}
+
+LC3MemoryImage LC3MemoryImage::fromWords(uint16_t origin, std::span<const uint16_t> words)
+{
+    LC3MemoryImage image;
+    std::size_t count = std::min(words.size(), LC3Memory::Size - origin);
+    for (std::size_t done = 0; done < count;) {
+        std::size_t address = origin + done;
+        std::size_t page = address >> LC3Memory::PageBits;
+        std::size_t offset = address & LC3Memory::PageMask;
+        std::size_t chunk = std::min(count - done, LC3Memory::PageSize - offset);
+        if (!image.pages[page]) {
+            image.pages[page] = std::make_shared<LC3Memory::Page>();
+        }
+        std::memcpy(image.pages[page]->data() + offset, words.data() + done, chunk * sizeof(uint16_t));
+        done += chunk;
     }
+    return image;
 }
@@ -1,20 +1,170 @@
 #ifndef LC3MEMORY_H
 #define LC3MEMORY_H
 
+#include <array>
+#include <cstddef>
 #include <cstdint>
+#include <memory>
+#include <span>
 #include <vector>
 
 
+// A run of addresses [start, start + length); length can reach 0x10000
+struct LC3MemoryRange
+{
+    uint16_t start;
+    uint32_t length;
+};
+
+// Implemented by anything that mirrors memory (views, snapshots, trace writers,
+// display devices) so it only has to look at the pages that were written.
+class LC3MemoryObserver
+{
+public:
+    virtual ~LC3MemoryObserver() = default;
+    virtual void memoryChanged(std::span<const LC3MemoryRange> ranges) = 0;
+};
+
+class LC3MemoryImage;
+
 class LC3Memory
 {
 public:
-    LC3Memory(uint16_t size);
+    static constexpr std::size_t Size = 0x10000; // Full 16-bit address space, x0000 - xFFFF
+    static constexpr int PageBits = 8;
+    static constexpr std::size_t PageSize = std::size_t(1) << PageBits; // 256 words per page
+    static constexpr std::size_t PageCount = Size / PageSize;
+    static constexpr uint16_t PageMask = PageSize - 1;
+
+    using Page = std::array<uint16_t, PageSize>;
+
+    // Flat: one contiguous 128 KB block, allocated and zeroed up front.
+    // Paged: every page starts out pointing at a single shared, read-only zero page,
+    // and image pages are shared between machines; a page gets its own copy on first
+    // write, so the footprint follows the pages a program actually touches.
+    // External: the words live in a buffer owned by someone else, such as a
+    // memory-mapped file (see LC3MemoryFile); set up with attachExternal().
+    enum class Mode { Flat, Paged, External };
+
+    // The modes a memory can start in. External has no buffer to start with,
+    // so it is not one of them: construct Flat and call attachExternal().
+    enum class Layout { Flat, Paged };
+
+    explicit LC3Memory(Layout layout = Layout::Flat);
+    LC3Memory(const LC3Memory &) = delete;
+    LC3Memory &operator=(const LC3Memory &) = delete;
+
+    Mode mode() const { return memoryMode; }
+
+    // Flat and External memory index their block directly; only Paged goes
+    // through the page table
+    uint16_t read(uint16_t address) const
+    {
+        if (words) [[likely]]
+            return words[address];
+        return (*pages[address >> PageBits])[address & PageMask];
+    }
+    void write(uint16_t address, uint16_t value)
+    {
+        std::size_t page = address >> PageBits;
+        if (words) [[likely]] {
+            if (sequence) [[unlikely]] {
+                writeSequenced(page, address, value);
+                return;
+            }
+            words[address] = value;
+        } else {
+            if (!isPagePrivate(page))
+                makePagePrivate(page, true);
+            (*pages[page])[address & PageMask] = value;
+        }
+        markDirty(page);
+    }
+
+    // Block operations. Ranges running past xFFFF are clipped to the end of memory,
+    // and the number of words actually transferred is returned.
+    std::size_t readBlock(uint16_t start, std::span<uint16_t> out) const;
+    std::size_t writeBlock(uint16_t start, std::span<const uint16_t> data);
+    std::size_t fill(uint16_t start, std::size_t count, uint16_t value);
+    std::size_t copy(uint16_t destination, uint16_t source, std::size_t count);
+    void clear();
+
+    // Replaces the whole contents with an image. In paged mode the image pages are
+    // shared rather than copied until this machine writes to them.
+    void loadImage(const LC3MemoryImage &image);
+
+    // Switches to a caller-owned array of Size words, keeping whatever it already
+    // holds. When writeSequence is given it is used as a seqlock: it is odd while
+    // a write is in progress, so readers in other processes can detect torn copies.
+    // detachExternal() copies the words back into a private flat block.
+    void attachExternal(uint16_t *buffer, uint64_t *writeSequence = nullptr);
+    void detachExternal();
+
+    // Direct page access for bulk consumers (diff, search, snapshots)
+    const uint16_t *pageData(std::size_t page) const { return pages[page]->data(); }
+    bool isPagePrivate(std::size_t page) const { return (privatePages[page >> 6] >> (page & 63)) & 1; }
+    std::size_t privatePageCount() const;
+
+    // Write tracking. Every write sets the dirty bit of its page; dirtyRanges()
+    // coalesces neighbouring dirty pages and clearDirty() resets the bitmap.
+    bool isPageDirty(std::size_t page) const { return (dirty[page >> 6] >> (page & 63)) & 1; }
+    bool hasDirtyPages() const;
+    std::vector<LC3MemoryRange> dirtyRanges() const;
+    void clearDirty() { dirty.fill(0); }
+
+    // Observers are handed the dirty ranges by publishChanges(), which then clears them
+    void addObserver(LC3MemoryObserver *observer);
+    void removeObserver(LC3MemoryObserver *observer);
+    void publishChanges();
+
+    static const std::shared_ptr<Page> &zeroPage();
+
+private:
+    friend class LC3MemoryImage;
+    using Bitmap = std::array<uint64_t, PageCount / 64>;
+
+    static std::size_t clip(uint16_t start, std::size_t count);
+    static void setBit(Bitmap &bits, std::size_t page) { bits[page >> 6] |= uint64_t(1) << (page & 63); }
+    static void clearBit(Bitmap &bits, std::size_t page) { bits[page >> 6] &= ~(uint64_t(1) << (page & 63)); }
+
+    void makePagePrivate(std::size_t page, bool keepContents);
+    void sharePage(std::size_t page, std::shared_ptr<Page> data);
+    void markDirty(std::size_t page) { setBit(dirty, page); }
+    void markDirty(uint16_t start, std::size_t count);
+    void writeSequenced(std::size_t page, uint16_t address, uint16_t value);
+    void beginSequencedWrite();
+    void endSequencedWrite();
+    void allocateFlat();
+
+    Mode memoryMode;
+    uint16_t *words = nullptr; // Flat and External: the whole address space in one block
+    std::array<std::shared_ptr<Page>, PageCount> pages;
+    Bitmap privatePages{}; // Pages this instance may write in place
+    Bitmap dirty{};
+    uint64_t *sequence = nullptr;
+    std::vector<LC3MemoryObserver *> observers;
+};
+
+// An immutable memory image (a loaded program, a snapshot) whose non-zero pages
+// can be shared by any number of paged LC3Memory instances.
+class LC3MemoryImage
+{
+public:
+    LC3MemoryImage();
+
+    static LC3MemoryImage capture(const LC3Memory &memory);
+    // Pages that still hold what they hold in base are shared with it rather than
+    // copied, so a page pointer that differs from base's marks a changed page.
+    // Every private page is compared with base's, whether or not it was written
+    // since base: the dirty bits belong to publishChanges() and may be cleared.
+    static LC3MemoryImage capture(const LC3Memory &memory, const LC3MemoryImage &base);
+    static LC3MemoryImage fromWords(uint16_t origin, std::span<const uint16_t> words);
 
-    uint16_t read(uint16_t address) const;
-    void write(uint16_t address, uint16_t value);
+    // nullptr for pages that are all zero
+    const std::shared_ptr<LC3Memory::Page> &page(std::size_t index) const { return pages[index]; }
 
 private:
-    std::vector<uint16_t> memory;
+    std::array<std::shared_ptr<LC3Memory::Page>, LC3Memory::PageCount> pages;
 };
 
 #endif // LC3MEMORY_H
@@ -0,0 +1,106 @@
+#include "lc3memoryfile.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+static const char MemoryFileMagic[8] = {'L', 'C', '3', 'M', 'E', 'M', 0, 0};
+
+LC3MemoryFile::LC3MemoryFile(const QString &fileName)
+{
+    file.setFileName(fileName);
+}
+
+LC3MemoryFile::~LC3MemoryFile()
+{
+    close();
+}
+
+bool LC3MemoryFile::open()
+{
+    if (!file.open(QIODevice::ReadWrite)) {
+        error = "Cannot open memory file: " + file.errorString();
+        return false;
+    }
+
+    bool fresh = file.size() == 0;
+    if (!fresh && file.size() != FileSize) {
+        error = "Not an LC3 memory file (unexpected size): " + file.fileName();
+        file.close();
+        return false;
+    }
+    if (fresh && !file.resize(FileSize)) {
+        error = "Cannot size memory file: " + file.errorString();
+        file.close();
+        return false;
+    }
+
+    uchar *mapping = file.map(0, FileSize);
+    if (!mapping) {
+        error = "Cannot map memory file: " + file.errorString();
+        file.close();
+        return false;
+    }
+    header = reinterpret_cast<LC3MemoryFileHeader *>(mapping);
+
+    if (fresh) {
+        // resize() zero-fills, so only the header needs writing
+        std::memcpy(header->magic, MemoryFileMagic, sizeof(MemoryFileMagic));
+        header->version = Version;
+        header->wordCount = LC3Memory::Size;
+        header->headerSize = sizeof(LC3MemoryFileHeader);
+    } else if (std::memcmp(header->magic, MemoryFileMagic, sizeof(MemoryFileMagic)) != 0
+               || header->version != Version || header->wordCount != LC3Memory::Size
+               || header->headerSize != sizeof(LC3MemoryFileHeader)) {
+        error = "Not an LC3 memory file (bad header): " + file.fileName();
+        close();
+        return false;
+    }
+
+    // A crash mid-write can leave the counter odd; make it even again
+    if (header->sequence & 1) {
+        header->sequence++;
+    }
+    return true;
+}
+
+void LC3MemoryFile::close()
+{
+    if (attached) {
+        attached->detachExternal();
+        attached = nullptr;
+    }
+    if (header) {
+        file.unmap(reinterpret_cast<uchar *>(header));
+        header = nullptr;
+    }
+    file.close();
+}
+
+void LC3MemoryFile::attach(LC3Memory &memory)
+{
+    if (!header)
+        return;
+
+    uint16_t *words = reinterpret_cast<uint16_t *>(reinterpret_cast<uchar *>(header) + header->headerSize);
+    memory.attachExternal(words, &header->sequence);
+    attached = &memory;
+}
+
+bool LC3MemoryFile::readSnapshot(const uchar *mapping, std::span<uint16_t> out, int maxAttempts)
+{
+    const LC3MemoryFileHeader *fileHeader = reinterpret_cast<const LC3MemoryFileHeader *>(mapping);
+    const uint16_t *words = reinterpret_cast<const uint16_t *>(mapping + fileHeader->headerSize);
+    std::atomic_ref<uint64_t> sequence(const_cast<uint64_t &>(fileHeader->sequence)); // Only loaded
+    std::size_t count = std::min<std::size_t>(out.size(), fileHeader->wordCount);
+
+    for (int attempt = 0; attempt < maxAttempts; ++attempt) {
+        uint64_t before = sequence.load(std::memory_order_acquire);
+        if (before & 1)
+            continue; // Writer active
+        std::memcpy(out.data(), words, count * sizeof(uint16_t));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (sequence.load(std::memory_order_relaxed) == before)
+            return true;
+    }
+    return false;
+}
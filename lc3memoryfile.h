@@ -0,0 +1,55 @@
+#ifndef LC3MEMORYFILE_H
+#define LC3MEMORYFILE_H
+
+#include <QFile>
+#include <QString>
+#include <cstdint>
+#include <span>
+#include "lc3memory.h"
+
+// Layout of a memory file: this 64-byte header followed by the raw 64K-word array
+// (host byte order, i.e. little-endian on x86 and ARM). Any process can map the
+// same file read-only and see the machine's memory live.
+struct LC3MemoryFileHeader
+{
+    char magic[8];        // "LC3MEM\0\0"
+    uint32_t version;     // LC3MemoryFile::Version
+    uint32_t wordCount;   // LC3Memory::Size
+    uint32_t headerSize;  // Byte offset of the word array
+    uint32_t reserved0;
+    uint64_t sequence;    // Seqlock: odd while the simulator is writing
+    uint8_t reserved[32];
+};
+static_assert(sizeof(LC3MemoryFileHeader) == 64, "memory file header must stay 64 bytes");
+
+class LC3MemoryFile
+{
+public:
+    static constexpr uint32_t Version = 1;
+    static constexpr qint64 FileSize = sizeof(LC3MemoryFileHeader) + LC3Memory::Size * sizeof(uint16_t);
+
+    explicit LC3MemoryFile(const QString &fileName);
+    ~LC3MemoryFile();
+
+    // Maps the file, creating and zero-filling it if it does not exist yet
+    bool open();
+    void close();
+    bool isOpen() const { return header != nullptr; }
+    QString errorString() const { return error; }
+
+    // Backs memory with the mapped words; the machine picks up where the file left off.
+    void attach(LC3Memory &memory);
+
+    // Reader side of the seqlock, for tools that map the file themselves: copies
+    // the words out and retries while a write was in progress. Returns false if no
+    // consistent copy could be taken within maxAttempts.
+    static bool readSnapshot(const uchar *mapping, std::span<uint16_t> out, int maxAttempts = 1000);
+
+private:
+    QFile file;
+    LC3MemoryFileHeader *header = nullptr;
+    LC3Memory *attached = nullptr;
+    QString error;
+};
+
+#endif // LC3MEMORYFILE_H
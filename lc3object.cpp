@@ -0,0 +1,356 @@
+#include "lc3object.h"
+#include "asmpreprocessor.h"
+#include "asmsections.h"
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QtConcurrent/QtConcurrentMap>
+#include <QtEndian>
+#include <bitset>
+
+static const char ObjectMagic[8] = {'L', 'C', '3', 'O', 'B', 'J', 0, 0};
+
+QByteArray LC3Object::serialize() const
+{
+    QByteArray data;
+    QDataStream out(&data, QIODevice::WriteOnly);
+    out.setByteOrder(QDataStream::LittleEndian);
+    out.writeRawData(ObjectMagic, sizeof(ObjectMagic));
+    out << quint32(Version) << moduleName;
+
+    out << quint32(sections.size());
+    for (const LC3ObjectSection &section : sections)
+    {
+        std::vector<uint16_t> words(section.words.size());
+        qToLittleEndian<quint16>(section.words.data(), words.size(), words.data());
+        out << quint8(section.relocatable) << quint16(section.origin) << quint32(words.size());
+        out.writeRawData(reinterpret_cast<const char *>(words.data()), int(words.size() * sizeof(uint16_t)));
+        out.writeRawData(reinterpret_cast<const char *>(section.emitted.data()), int(section.emitted.size()));
+    }
+
+    out << quint32(symbols.size());
+    for (const LC3ObjectSymbol &symbol : symbols)
+        out << symbol.name << quint32(symbol.section) << quint16(symbol.offset) << quint8(symbol.exported) << qint32(symbol.line);
+
+    out << quint32(relocations.size());
+    for (const LC3Relocation &relocation : relocations)
+        out << quint32(relocation.section) << quint16(relocation.offset) << quint8(relocation.width) << qint32(relocation.line) << relocation.symbol;
+
+    out << quint32(imports.size());
+    for (const auto &[name, line] : imports)
+        out << name << qint32(line);
+    return data;
+}
+
+bool LC3Object::deserialize(const QByteArray &data)
+{
+    QDataStream in(data);
+    in.setByteOrder(QDataStream::LittleEndian);
+
+    char magic[sizeof(ObjectMagic)];
+    quint32 version = 0, count = 0;
+    if (in.readRawData(magic, sizeof(magic)) != int(sizeof(magic)) || std::memcmp(magic, ObjectMagic, sizeof(magic)) != 0)
+        return false;
+    in >> version >> moduleName;
+    if (version != Version)
+        return false;
+
+    in >> count;
+    sections.assign(std::min<quint32>(count, 0x10000), {});
+    for (LC3ObjectSection &section : sections)
+    {
+        quint8 relocatable = 0;
+        quint16 origin = 0;
+        quint32 size = 0;
+        in >> relocatable >> origin >> size;
+        if (in.status() != QDataStream::Ok || size > LC3Memory::Size)
+            return false;
+        section.relocatable = relocatable;
+        section.origin = origin;
+        section.words.resize(size);
+        section.emitted.resize(size);
+        in.readRawData(reinterpret_cast<char *>(section.words.data()), int(size * sizeof(uint16_t)));
+        in.readRawData(reinterpret_cast<char *>(section.emitted.data()), int(size));
+        qFromLittleEndian<quint16>(section.words.data(), size, section.words.data());
+    }
+
+    in >> count;
+    symbols.clear();
+    for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; ++i)
+    {
+        LC3ObjectSymbol symbol;
+        quint32 section = 0;
+        quint16 offset = 0;
+        quint8 exported = 0;
+        qint32 line = 0;
+        in >> symbol.name >> section >> offset >> exported >> line;
+        if (section >= sections.size())
+            return false;
+        symbol.section = section;
+        symbol.offset = offset;
+        symbol.exported = exported;
+        symbol.line = line;
+        symbols.push_back(std::move(symbol));
+    }
+
+    in >> count;
+    relocations.clear();
+    for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; ++i)
+    {
+        LC3Relocation relocation;
+        quint32 section = 0;
+        quint16 offset = 0;
+        quint8 width = 0;
+        qint32 line = 0;
+        in >> section >> offset >> width >> line >> relocation.symbol;
+        if (section >= sections.size() || offset >= sections[section].words.size() || width == 0 || width > 16)
+            return false;
+        relocation.section = section;
+        relocation.offset = offset;
+        relocation.width = width;
+        relocation.line = line;
+        relocations.push_back(std::move(relocation));
+    }
+
+    in >> count;
+    imports.clear();
+    for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; ++i)
+    {
+        QString name;
+        qint32 line = 0;
+        in >> name >> line;
+        imports.append({name, line});
+    }
+    errors.clear();
+    return in.status() == QDataStream::Ok;
+}
+
+LC3Object assembleObject(std::string_view source, const QString &moduleName)
+{
+    LC3Object object;
+    object.moduleName = moduleName;
+
+    std::vector<AsmSection> sections;
+    if (!splitSections(source, sections))
+    {
+        object.errors.append({0, "Invalid ORG address"});
+        return object;
+    }
+    if (sections.size() > 1)
+    {
+        AsmIncbinFiles *files = AsmIncbinScope::current(); // The pool threads read through the same set
+        QtConcurrent::blockingMap(sections, [files](AsmSection &section) {
+            AsmIncbinScope incbin(files);
+            assembleSection(section);
+        });
+    }
+    else
+        assembleSection(sections.front());
+
+    QMap<QString, std::size_t> symbolIndex;
+    for (std::size_t i = 0; i < sections.size(); ++i)
+    {
+        AsmSection &section = sections[i];
+        if (!section.originLabel.isEmpty())
+        {
+            // The label on an ORG line marks the end of the section before it,
+            // whose words have already been moved into the object
+            symbolIndex[section.originLabel] = object.symbols.size();
+            object.symbols.push_back({section.originLabel, uint32_t(i - 1),
+                                      uint16_t(object.sections[i - 1].words.size()), false, int(section.firstLine)});
+        }
+        for (const auto &[name, line] : std::as_const(section.definitions))
+        {
+            symbolIndex[name] = object.symbols.size();
+            object.symbols.push_back({name, uint32_t(i), uint16_t(section.labels.value(name) - section.origin), false, line});
+        }
+        for (const auto &[label, fixup] : std::as_const(section.external))
+            object.relocations.push_back({uint32_t(i), uint16_t(fixup.address - section.origin), fixup.width, fixup.line, label});
+        object.imports.append(section.imports);
+        object.errors.append(section.errors);
+
+        LC3ObjectSection &out = object.sections.emplace_back();
+        out.relocatable = i == 0;
+        out.origin = section.origin;
+        out.words = std::move(section.words);
+        out.emitted = std::move(section.emitted);
+    }
+
+    for (const AsmSection &section : sections)
+    {
+        for (const auto &[name, line] : section.exports)
+        {
+            if (symbolIndex.contains(name))
+                object.symbols[symbolIndex.value(name)].exported = true;
+            else
+                object.errors.append({line, QString("Exported label %1 is not defined on line %2").arg(name).arg(line)});
+        }
+    }
+    return object;
+}
+
+uint32_t linkObjects(const std::vector<const LC3Object *> &objects, AsmSymbolTable &labels, LC3Memory &memory)
+{
+    AsmDiagnostics errors;
+    auto report = [&](const LC3Object *object, int line, const QString &message) {
+        errors.append({line, object->moduleName + ": " + message});
+    };
+
+    // Section addresses
+    std::vector<std::vector<uint16_t>> bases(objects.size());
+    uint16_t cursor = 0x3000;
+    for (std::size_t i = 0; i < objects.size(); ++i)
+    {
+        for (const LC3ObjectSection &section : objects[i]->sections)
+        {
+            bases[i].push_back(section.relocatable ? cursor : section.origin);
+            if (section.relocatable)
+                cursor = static_cast<uint16_t>(cursor + section.words.size());
+        }
+    }
+
+    // Each module's own labels, and the labels modules export to each other
+    std::vector<AsmSymbolTable> local(objects.size());
+    QMap<QString, const LC3Object *> exporters;
+    for (std::size_t i = 0; i < objects.size(); ++i)
+    {
+        for (const LC3ObjectSymbol &symbol : objects[i]->symbols)
+        {
+            uint16_t address = static_cast<uint16_t>(bases[i][symbol.section] + symbol.offset);
+            if (local[i].contains(symbol.name))
+                report(objects[i], symbol.line, QString("Label %1 redefined on line %2").arg(symbol.name).arg(symbol.line));
+            local[i].insert(symbol.name, address);
+            if (!symbol.exported)
+                continue;
+            if (exporters.contains(symbol.name))
+                report(objects[i], symbol.line, QString("Label %1 is also exported by %2").arg(symbol.name, exporters.value(symbol.name)->moduleName));
+            exporters[symbol.name] = objects[i];
+            labels.insert(symbol.name, address);
+        }
+    }
+
+    std::bitset<LC3Memory::Size> written;
+    uint32_t endAddress = 0x3000;
+    for (std::size_t i = 0; i < objects.size(); ++i)
+    {
+        const LC3Object *object = objects[i];
+        QVector<QString> imported;
+        for (const auto &import : object->imports)
+            imported.append(import.first);
+
+        std::vector<std::vector<uint16_t>> words;
+        for (const LC3ObjectSection &section : object->sections)
+            words.push_back(section.words);
+
+        for (const LC3Relocation &relocation : object->relocations)
+        {
+            uint16_t target;
+            if (local[i].contains(relocation.symbol))
+                target = local[i].value(relocation.symbol);
+            else if (imported.contains(relocation.symbol) && labels.contains(relocation.symbol))
+                target = labels.value(relocation.symbol);
+            else
+            {
+                report(object, relocation.line, imported.contains(relocation.symbol)
+                                   ? QString("Imported label %1 is not exported by any module (line %2)").arg(relocation.symbol).arg(relocation.line)
+                                   : QString("Undefined label %1 on line %2").arg(relocation.symbol).arg(relocation.line));
+                continue;
+            }
+
+            uint16_t address = static_cast<uint16_t>(bases[i][relocation.section] + relocation.offset);
+            uint16_t packed;
+            if (!lc3SignedField(static_cast<int16_t>(target - address - 1), relocation.width, packed))
+                report(object, relocation.line, QString("PC offset to %1 out of range on line %2").arg(relocation.symbol).arg(relocation.line));
+            else
+                words[relocation.section][relocation.offset] |= packed;
+        }
+
+        for (std::size_t s = 0; s < words.size(); ++s)
+        {
+            const std::vector<uint8_t> &emitted = object->sections[s].emitted;
+            bool overlapReported = false;
+            for (std::size_t w = 0; w < words[s].size(); ++w)
+            {
+                if (!emitted[w])
+                    continue;
+                uint16_t address = static_cast<uint16_t>(bases[i][s] + w);
+                if (written.test(address) && !overlapReported)
+                {
+                    report(object, 0, "Code overlaps earlier code at x" + QString("%1").arg(address, 4, 16, QChar('0')).toUpper());
+                    overlapReported = true;
+                }
+                written.set(address);
+                memory.write(address, words[s][w]);
+                endAddress = std::max<uint32_t>(endAddress, address + 1u);
+            }
+        }
+    }
+
+    for (const AsmDiagnostic &error : std::as_const(errors))
+        reportAssemblyError(error.line, error.message);
+    return endAddress;
+}
+
+LC3ObjectCache::LC3ObjectCache(const QString &directory)
+    : directory(directory)
+{
+    QDir().mkpath(directory);
+}
+
+bool LC3ObjectCache::build(const QString &fileName, LC3Object &object)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+    QByteArray source = file.readAll();
+
+    // .INCLUDE and .MACRO are expanded before the section split. The key is taken
+    // after expansion, so editing an include file is a miss.
+    std::string_view text(source.constData(), source.size());
+    AsmDiagnostics preprocessErrors;
+    AsmPreprocessed expanded;
+    if (asmNeedsPreprocessing(text))
+    {
+        AsmDiagnosticCollector collect(preprocessErrors);
+        preprocessAssembly(text, QFileInfo(fileName).absolutePath(), includes, expanded);
+        text = expanded.text;
+    }
+
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    hash.addData(QByteArrayView(text.data(), qsizetype(text.size())));
+    hash.addData(QByteArray::number(LC3Object::Version));
+    hash.addData(QByteArray::number(AssemblerVersion)); // A changed encoder makes different words
+    QString cachePath = QDir(directory).filePath(QString::fromLatin1(hash.result().toHex()) + ".lc3obj");
+
+    QFile cached(cachePath);
+    if (preprocessErrors.isEmpty() && cached.open(QIODevice::ReadOnly) && object.deserialize(cached.readAll()))
+    {
+        object.moduleName = fileName; // The same source may be cached under another path
+        cacheHits++;
+        return true;
+    }
+
+    cacheMisses++;
+    int reads = assemblyFileReads();
+    {
+        AsmIncbinFiles files(QFileInfo(fileName).absolutePath());
+        AsmIncbinScope incbin(&files);
+        object = assembleObject(text, fileName);
+    }
+    mapDiagnosticsToSource(object.errors, 0, expanded);
+    preprocessErrors.append(object.errors);
+    object.errors = std::move(preprocessErrors);
+    if (object.errors.isEmpty() && assemblyFileReads() == reads) // .INCBIN data is not in the key
+    {
+        QSaveFile out(cachePath); // Readers never see a half-written object
+        if (out.open(QIODevice::WriteOnly))
+        {
+            out.write(object.serialize());
+            out.commit();
+        }
+    }
+    return true;
+}
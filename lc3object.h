@@ -0,0 +1,97 @@
+#ifndef LC3OBJECT_H
+#define LC3OBJECT_H
+
+#include "asmdiagnostics.h"
+#include "asmpreprocessor.h"
+#include "asmsymbols.h"
+#include "lc3memory.h"
+#include <QByteArray>
+#include <QMap>
+#include <QPair>
+#include <QString>
+#include <QVector>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// Relocatable output of assembling one module. Code before the module's first
+// ORG is relocatable: the linker decides where it goes. Each ORG starts an
+// absolute section. PC offsets to labels in the same section are already
+// encoded, since they do not change when the section moves. Every other label
+// reference is left as a relocation for the linker.
+struct LC3ObjectSection
+{
+    bool relocatable = false;
+    uint16_t origin = 0;           // Absolute sections only
+    std::vector<uint16_t> words;
+    std::vector<uint8_t> emitted;  // 0 where a statement was rejected and wrote nothing
+};
+
+struct LC3ObjectSymbol
+{
+    QString name;
+    uint32_t section;
+    uint16_t offset;
+    bool exported;
+    int line;
+};
+
+// OR a signed PC offset to symbol into the word at section:offset
+struct LC3Relocation
+{
+    uint32_t section;
+    uint16_t offset;
+    uint8_t width;
+    int line;
+    QString symbol;
+};
+
+struct LC3Object
+{
+    static constexpr uint32_t Version = 1;
+
+    QString moduleName;
+    std::vector<LC3ObjectSection> sections;
+    std::vector<LC3ObjectSymbol> symbols;
+    std::vector<LC3Relocation> relocations;
+    QVector<QPair<QString, int>> imports;  // Label and line
+    AsmDiagnostics errors;                 // Objects with errors are never cached
+
+    QByteArray serialize() const;
+    bool deserialize(const QByteArray &data);
+};
+
+LC3Object assembleObject(std::string_view source, const QString &moduleName);
+
+// Places relocatable sections one after another from x3000 in module order, and
+// absolute sections at their origins. Then resolves relocations: a module's own
+// labels first, then labels exported by other modules, which must be IMPORTed.
+// Reports errors with the module name, writes the image, fills labels with every
+// exported symbol and returns one past the highest address written.
+uint32_t linkObjects(const std::vector<const LC3Object *> &objects, AsmSymbolTable &labels, LC3Memory &memory);
+
+// On-disk cache of objects keyed by a hash of the module source after .INCLUDE
+// and .MACRO expansion, the object format version and AssemblerVersion. A module
+// whose expanded source has not changed is loaded, not assembled. Modules that
+// use .INCBIN are never stored, since the key does not cover the files they read.
+class LC3ObjectCache
+{
+public:
+    explicit LC3ObjectCache(const QString &directory);
+
+    // Assembles fileName, or reuses the cached object for the same source.
+    // False if the file cannot be read.
+    bool build(const QString &fileName, LC3Object &object);
+
+    int hits() const { return cacheHits; }
+    int misses() const { return cacheMisses; }
+    const AsmIncludeCache &includeCache() const { return includes; }
+
+private:
+    QString directory;
+    AsmIncludeCache includes; // Modules often include the same libraries
+    int cacheHits = 0;
+    int cacheMisses = 0;
+};
+
+#endif // LC3OBJECT_H
@@ -0,0 +1,276 @@
+#include "lc3programfile.h"
+#include <QDataStream>
+#include <QSaveFile>
+#include <QtEndian>
+#include <algorithm>
+#include <cstring>
+
+static const char ProgramMagic[8] = {'L', 'C', '3', 'P', 'R', 'G', 0, 0};
+
+static qint64 alignUp(qint64 offset)
+{
+    return (offset + 7) & ~qint64(7);
+}
+
+LC3ProgramFile::LC3ProgramFile(const QString &fileName)
+{
+    file.setFileName(fileName);
+}
+
+LC3ProgramFile::~LC3ProgramFile()
+{
+    close();
+}
+
+std::vector<LC3MemoryRange> LC3ProgramFile::usedRanges(const LC3Memory &image)
+{
+    std::vector<LC3MemoryRange> ranges;
+    auto used = [&image](std::size_t page) {
+        const uint16_t *words = image.pageData(page);
+        return std::any_of(words, words + LC3Memory::PageSize, [](uint16_t word) { return word != 0; });
+    };
+
+    std::size_t page = 0;
+    while (page < LC3Memory::PageCount)
+    {
+        if (!used(page))
+        {
+            ++page;
+            continue;
+        }
+        std::size_t first = page;
+        while (page < LC3Memory::PageCount && used(page))
+            ++page;
+
+        // Trim to the first and last non-zero word of the run
+        const uint16_t *head = image.pageData(first);
+        std::size_t start = first * LC3Memory::PageSize;
+        while (head[start & LC3Memory::PageMask] == 0)
+            ++start;
+        const uint16_t *tail = image.pageData(page - 1);
+        std::size_t end = page * LC3Memory::PageSize;
+        while (tail[(end - 1) & LC3Memory::PageMask] == 0)
+            --end;
+        ranges.push_back({static_cast<uint16_t>(start), static_cast<uint32_t>(end - start)});
+    }
+    return ranges;
+}
+
+bool LC3ProgramFile::save(const LC3Memory &image, uint16_t entry, const AsmSymbolTable &labels, const AsmSourceMap &sourceMap)
+{
+    std::vector<LC3MemoryRange> ranges = usedRanges(image);
+
+    std::vector<std::pair<SectionKind, QByteArray>> payloads;
+    auto addSection = [&payloads](SectionKind kind, const auto &value) {
+        QByteArray bytes;
+        QDataStream out(&bytes, QIODevice::WriteOnly);
+        out.setByteOrder(QDataStream::LittleEndian);
+        out << value;
+        payloads.emplace_back(kind, bytes);
+    };
+    if (!labels.isEmpty())
+        addSection(Symbols, labels);
+    if (!sourceMap.isEmpty())
+        addSection(SourceMap, sourceMap);
+
+    // Lay out the tables first, then the data they point at
+    qint64 offset = sizeof(LC3ProgramHeader) + ranges.size() * sizeof(LC3ProgramSegment)
+                  + payloads.size() * sizeof(LC3ProgramSection);
+    std::vector<LC3ProgramSegment> segments;
+    for (const LC3MemoryRange &range : ranges)
+    {
+        offset = alignUp(offset);
+        segments.push_back({qToLittleEndian<quint16>(range.start), 0, qToLittleEndian<quint32>(range.length),
+                            qToLittleEndian<quint64>(offset)});
+        offset += range.length * sizeof(uint16_t);
+    }
+    std::vector<LC3ProgramSection> sections;
+    for (const auto &[kind, bytes] : payloads)
+    {
+        offset = alignUp(offset);
+        sections.push_back({qToLittleEndian<quint32>(kind), 0, qToLittleEndian<quint64>(offset),
+                            qToLittleEndian<quint64>(bytes.size())});
+        offset += bytes.size();
+    }
+
+    LC3ProgramHeader header = {};
+    std::memcpy(header.magic, ProgramMagic, sizeof(ProgramMagic));
+    header.version = qToLittleEndian<quint32>(Version);
+    header.entry = qToLittleEndian<quint16>(entry);
+    header.segmentCount = qToLittleEndian<quint32>(static_cast<quint32>(segments.size()));
+    header.sectionCount = qToLittleEndian<quint32>(static_cast<quint32>(sections.size()));
+    header.fileSize = qToLittleEndian<quint64>(offset);
+
+    // Built whole in memory so the file is written with a single call
+    QByteArray contents(offset, 0);
+    char *out = contents.data();
+    std::memcpy(out, &header, sizeof(header));
+    std::memcpy(out + sizeof(header), segments.data(), segments.size() * sizeof(LC3ProgramSegment));
+    std::memcpy(out + sizeof(header) + segments.size() * sizeof(LC3ProgramSegment), sections.data(),
+                sections.size() * sizeof(LC3ProgramSection));
+    for (std::size_t i = 0; i < ranges.size(); ++i)
+    {
+        std::vector<uint16_t> words(ranges[i].length);
+        image.readBlock(ranges[i].start, words);
+        qToLittleEndian<quint16>(words.data(), words.size(), out + qFromLittleEndian<quint64>(segments[i].offset));
+    }
+    for (std::size_t i = 0; i < payloads.size(); ++i)
+    {
+        const QByteArray &bytes = payloads[i].second;
+        std::memcpy(out + qFromLittleEndian<quint64>(sections[i].offset), bytes.constData(), bytes.size());
+    }
+
+    QSaveFile output(file.fileName());
+    if (!output.open(QIODevice::WriteOnly) || output.write(contents) != contents.size() || !output.commit())
+        return fail("Cannot write " + file.fileName() + ": " + output.errorString());
+    return true;
+}
+
+bool LC3ProgramFile::open()
+{
+    close();
+    if (!file.open(QIODevice::ReadOnly))
+        return fail("Cannot open " + file.fileName() + ": " + file.errorString());
+    size = file.size();
+    if (size < qint64(sizeof(LC3ProgramHeader)))
+        return fail("Not an LC3 program file (too short): " + file.fileName());
+
+    mapping = file.map(0, size);
+    if (mapping)
+        data = mapping;
+    else
+    {
+        buffer = file.readAll();
+        if (buffer.size() != size)
+            return fail("Cannot read " + file.fileName() + ": " + file.errorString());
+        data = reinterpret_cast<const uchar *>(buffer.constData());
+    }
+
+    const LC3ProgramHeader &head = header();
+    quint32 segmentCount = qFromLittleEndian<quint32>(head.segmentCount);
+    quint32 sectionCount = qFromLittleEndian<quint32>(head.sectionCount);
+    if (std::memcmp(head.magic, ProgramMagic, sizeof(ProgramMagic)) != 0 || qFromLittleEndian<quint32>(head.version) != Version)
+        return fail("Not an LC3 program file (bad header): " + file.fileName());
+    if (qFromLittleEndian<quint64>(head.fileSize) != quint64(size) || segmentCount > LC3Memory::Size || sectionCount > 0xFFFF
+        || sizeof(LC3ProgramHeader) + quint64(segmentCount) * sizeof(LC3ProgramSegment)
+                   + quint64(sectionCount) * sizeof(LC3ProgramSection) > quint64(size))
+        return fail("Truncated LC3 program file: " + file.fileName());
+
+    for (quint32 i = 0; i < segmentCount; ++i)
+    {
+        const LC3ProgramSegment &segment = segmentTable()[i];
+        quint64 offset = qFromLittleEndian<quint64>(segment.offset);
+        quint64 length = qFromLittleEndian<quint32>(segment.length);
+        if (offset % alignof(uint16_t) != 0 || offset > quint64(size) || length * sizeof(uint16_t) > quint64(size) - offset
+            || qFromLittleEndian<quint16>(segment.origin) + length > LC3Memory::Size)
+            return fail("Corrupt segment table: " + file.fileName());
+    }
+    for (quint32 i = 0; i < sectionCount; ++i)
+    {
+        const LC3ProgramSection &section = sectionTable()[i];
+        quint64 offset = qFromLittleEndian<quint64>(section.offset);
+        if (offset > quint64(size) || qFromLittleEndian<quint64>(section.size) > quint64(size) - offset)
+            return fail("Corrupt section table: " + file.fileName());
+    }
+    return true;
+}
+
+void LC3ProgramFile::close()
+{
+    if (mapping)
+    {
+        file.unmap(mapping);
+        mapping = nullptr;
+    }
+    buffer.clear();
+    data = nullptr;
+    size = 0;
+    file.close();
+}
+
+bool LC3ProgramFile::fail(const QString &message)
+{
+    error = message;
+    close();
+    return false;
+}
+
+const LC3ProgramSegment *LC3ProgramFile::segmentTable() const
+{
+    return reinterpret_cast<const LC3ProgramSegment *>(data + sizeof(LC3ProgramHeader));
+}
+
+const LC3ProgramSection *LC3ProgramFile::sectionTable() const
+{
+    return reinterpret_cast<const LC3ProgramSection *>(segmentTable() + qFromLittleEndian<quint32>(header().segmentCount));
+}
+
+uint16_t LC3ProgramFile::entry() const
+{
+    return qFromLittleEndian<quint16>(header().entry);
+}
+
+std::vector<LC3MemoryRange> LC3ProgramFile::segments() const
+{
+    std::vector<LC3MemoryRange> ranges;
+    for (quint32 i = 0; i < qFromLittleEndian<quint32>(header().segmentCount); ++i)
+    {
+        const LC3ProgramSegment &segment = segmentTable()[i];
+        ranges.push_back({qFromLittleEndian<quint16>(segment.origin), qFromLittleEndian<quint32>(segment.length)});
+    }
+    return ranges;
+}
+
+void LC3ProgramFile::load(LC3Memory &memory) const
+{
+    memory.clear();
+    for (quint32 i = 0; i < qFromLittleEndian<quint32>(header().segmentCount); ++i)
+    {
+        const LC3ProgramSegment &segment = segmentTable()[i];
+        const uchar *bytes = data + qFromLittleEndian<quint64>(segment.offset);
+        std::size_t length = qFromLittleEndian<quint32>(segment.length);
+        uint16_t origin = qFromLittleEndian<quint16>(segment.origin);
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+        // The mapped words are already in host order
+        memory.writeBlock(origin, std::span<const uint16_t>(reinterpret_cast<const uint16_t *>(bytes), length));
+#else
+        std::vector<uint16_t> words(length);
+        qFromLittleEndian<quint16>(bytes, length, words.data());
+        memory.writeBlock(origin, words);
+#endif
+    }
+}
+
+QByteArray LC3ProgramFile::section(SectionKind kind) const
+{
+    const LC3ProgramSection *sections = sectionTable();
+    for (quint32 i = 0; i < qFromLittleEndian<quint32>(header().sectionCount); ++i)
+    {
+        if (qFromLittleEndian<quint32>(sections[i].kind) == kind)
+            return QByteArray::fromRawData(reinterpret_cast<const char *>(data + qFromLittleEndian<quint64>(sections[i].offset)),
+                                           qsizetype(qFromLittleEndian<quint64>(sections[i].size)));
+    }
+    return QByteArray();
+}
+
+bool LC3ProgramFile::readSymbols(AsmSymbolTable &labels) const
+{
+    QByteArray bytes = section(Symbols);
+    if (bytes.isEmpty())
+        return false;
+    QDataStream in(bytes);
+    in.setByteOrder(QDataStream::LittleEndian);
+    in >> labels;
+    return in.status() == QDataStream::Ok;
+}
+
+bool LC3ProgramFile::readSourceMap(AsmSourceMap &sourceMap) const
+{
+    QByteArray bytes = section(SourceMap);
+    if (bytes.isEmpty())
+        return false;
+    QDataStream in(bytes);
+    in.setByteOrder(QDataStream::LittleEndian);
+    in >> sourceMap;
+    return in.status() == QDataStream::Ok;
+}
@@ -0,0 +1,105 @@
+#ifndef LC3PROGRAMFILE_H
+#define LC3PROGRAMFILE_H
+
+#include "asmsourcemap.h"
+#include "asmsymbols.h"
+#include "lc3memory.h"
+#include <QByteArray>
+#include <QFile>
+#include <QString>
+#include <cstdint>
+#include <vector>
+
+// Layout of a program file (MEMORY.lc3). All fields are little-endian:
+//   LC3ProgramHeader
+//   segmentCount LC3ProgramSegment entries, by origin
+//   sectionCount LC3ProgramSection entries
+//   the words of each segment, then each section's payload, each on an 8-byte boundary
+// A loader maps the file, checks the two tables, and copies every segment into
+// memory with one block write.
+struct LC3ProgramHeader
+{
+    char magic[8];         // "LC3PRG\0\0"
+    uint32_t version;      // LC3ProgramFile::Version
+    uint16_t entry;        // Where the PC starts
+    uint16_t reserved0;
+    uint32_t segmentCount;
+    uint32_t sectionCount;
+    uint64_t fileSize;     // Catches a truncated file
+};
+static_assert(sizeof(LC3ProgramHeader) == 32, "program file header must stay 32 bytes");
+
+struct LC3ProgramSegment
+{
+    uint16_t origin;
+    uint16_t reserved;
+    uint32_t length;       // Words; up to 0x10000
+    uint64_t offset;       // Byte offset of the words
+};
+static_assert(sizeof(LC3ProgramSegment) == 16, "program segment entry must stay 16 bytes");
+
+struct LC3ProgramSection
+{
+    uint32_t kind;         // LC3ProgramFile::SectionKind; loaders skip kinds they do not know
+    uint32_t reserved;
+    uint64_t offset;
+    uint64_t size;         // Bytes
+};
+static_assert(sizeof(LC3ProgramSection) == 24, "program section entry must stay 24 bytes");
+
+class LC3ProgramFile
+{
+public:
+    static constexpr uint32_t Version = 1;
+
+    // Payloads are written by QDataStream (little-endian)
+    enum SectionKind : uint32_t { Symbols = 1, SourceMap = 2 };
+
+    explicit LC3ProgramFile(const QString &fileName);
+    ~LC3ProgramFile();
+    LC3ProgramFile(const LC3ProgramFile &) = delete;
+    LC3ProgramFile &operator=(const LC3ProgramFile &) = delete;
+
+    // Writes every run of memory the program uses (see usedRanges) as a segment,
+    // and the symbol table and source map when they are not empty. The file is
+    // replaced atomically.
+    bool save(const LC3Memory &image, uint16_t entry, const AsmSymbolTable &labels = AsmSymbolTable(),
+              const AsmSourceMap &sourceMap = AsmSourceMap());
+
+    // Maps the file (or reads it, where it cannot be mapped) and checks the header
+    // and both tables, so the accessors below never read out of bounds.
+    bool open();
+    void close();
+    bool isOpen() const { return data != nullptr; }
+    QString errorString() const { return error; }
+
+    uint16_t entry() const;
+    std::vector<LC3MemoryRange> segments() const;
+
+    // Clears memory and copies each segment in
+    void load(LC3Memory &memory) const;
+    // False if the file has no such section or it does not parse
+    bool readSymbols(AsmSymbolTable &labels) const;
+    bool readSourceMap(AsmSourceMap &sourceMap) const;
+
+    // The runs of memory a program occupies: pages holding a non-zero word,
+    // neighbours joined, trimmed to the first and last non-zero word. load()
+    // clears memory first, so the zeros left out read back the same.
+    static std::vector<LC3MemoryRange> usedRanges(const LC3Memory &image);
+
+private:
+    const LC3ProgramHeader &header() const { return *reinterpret_cast<const LC3ProgramHeader *>(data); }
+    const LC3ProgramSegment *segmentTable() const;
+    const LC3ProgramSection *sectionTable() const;
+    QByteArray section(SectionKind kind) const;
+    bool fail(const QString &message);
+
+    QFile file;
+    uchar *mapping = nullptr;
+    QByteArray buffer;          // The contents when the file could not be mapped
+    const uchar *data = nullptr;
+    qint64 size = 0;
+    QString error;
+};
+
+#endif // LC3PROGRAMFILE_H
@@ -1,13 +1,34 @@
 
 #include "Logic.h"
+#include "lc3memoryfile.h"
 
 #include <QApplication>
+#include <QCommandLineParser>
 
 int main(int argc, char *argv[])
 {
     QApplication app(argc, argv);
     QIcon icon(":/new/prefix1/icon.png"); // Replace with actual path
     app.setWindowIcon(icon);
+
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    QCommandLineOption memoryFileOption("memory-file",
+                                        "Back machine memory with a memory-mapped <file> that persists across runs.",
+                                        "file");
+    parser.addOption(memoryFileOption);
+    parser.process(app);
+
+    // Declared before the window so memory is detached only after the window is gone
+    LC3MemoryFile memoryFile(parser.value(memoryFileOption));
+    if (parser.isSet(memoryFileOption)) {
+        if (memoryFile.open()) {
+            memoryFile.attach(memory);
+        } else {
+            QMessageBox::warning(nullptr, "Memory File", memoryFile.errorString());
+        }
+    }
+
     Logic w;
     w.show();
     return app.exec();
@@ -0,0 +1,287 @@
+#include "memorysearch.h"
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define LC3_SIMD_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define LC3_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define LC3_TARGET_AVX2
+#endif
+
+namespace {
+
+// Each kernel returns the first index in [0, count) that satisfies it, or count.
+//  - scanCompare: a[i] == b[i] is equal to wantEqual
+//  - scanPair:    a[i] == first && a[i + 1] == second (a[count] must be readable)
+struct Kernels
+{
+    std::size_t (*scanCompare)(const uint16_t *a, const uint16_t *b, std::size_t count, bool wantEqual);
+    std::size_t (*scanValue)(const uint16_t *a, std::size_t count, uint16_t value);
+    std::size_t (*scanPair)(const uint16_t *a, std::size_t count, uint16_t first, uint16_t second);
+    const char *name;
+};
+
+std::size_t scanCompareScalar(const uint16_t *a, const uint16_t *b, std::size_t count, bool wantEqual)
+{
+    std::size_t i = 0;
+    while (i < count && (a[i] == b[i]) != wantEqual)
+        ++i;
+    return i;
+}
+
+std::size_t scanValueScalar(const uint16_t *a, std::size_t count, uint16_t value)
+{
+    return std::find(a, a + count, value) - a;
+}
+
+std::size_t scanPairScalar(const uint16_t *a, std::size_t count, uint16_t first, uint16_t second)
+{
+    std::size_t i = 0;
+    while (i < count && !(a[i] == first && a[i + 1] == second))
+        ++i;
+    return i;
+}
+
+#ifdef LC3_SIMD_X86
+
+// movemask gives two bits per 16-bit lane, hence the division by two
+std::size_t scanCompareSse2(const uint16_t *a, const uint16_t *b, std::size_t count, bool wantEqual)
+{
+    unsigned flip = wantEqual ? 0 : 0xFFFF;
+    std::size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i));
+        __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i));
+        unsigned mask = unsigned(_mm_movemask_epi8(_mm_cmpeq_epi16(x, y))) ^ flip;
+        if (mask)
+            return i + std::countr_zero(mask) / 2;
+    }
+    return i + scanCompareScalar(a + i, b + i, count - i, wantEqual);
+}
+
+std::size_t scanValueSse2(const uint16_t *a, std::size_t count, uint16_t value)
+{
+    __m128i needle = _mm_set1_epi16(static_cast<short>(value));
+    std::size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i));
+        unsigned mask = unsigned(_mm_movemask_epi8(_mm_cmpeq_epi16(x, needle)));
+        if (mask)
+            return i + std::countr_zero(mask) / 2;
+    }
+    return i + scanValueScalar(a + i, count - i, value);
+}
+
+std::size_t scanPairSse2(const uint16_t *a, std::size_t count, uint16_t first, uint16_t second)
+{
+    __m128i needle0 = _mm_set1_epi16(static_cast<short>(first));
+    __m128i needle1 = _mm_set1_epi16(static_cast<short>(second));
+    std::size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i x0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i));
+        __m128i x1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i + 1));
+        __m128i hit = _mm_and_si128(_mm_cmpeq_epi16(x0, needle0), _mm_cmpeq_epi16(x1, needle1));
+        unsigned mask = unsigned(_mm_movemask_epi8(hit));
+        if (mask)
+            return i + std::countr_zero(mask) / 2;
+    }
+    return i + scanPairScalar(a + i, count - i, first, second);
+}
+
+LC3_TARGET_AVX2 std::size_t scanCompareAvx2(const uint16_t *a, const uint16_t *b, std::size_t count, bool wantEqual)
+{
+    uint32_t flip = wantEqual ? 0 : 0xFFFFFFFFu;
+    std::size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i));
+        __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i));
+        uint32_t mask = uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi16(x, y))) ^ flip;
+        if (mask)
+            return i + std::countr_zero(mask) / 2;
+    }
+    return i + scanCompareSse2(a + i, b + i, count - i, wantEqual);
+}
+
+LC3_TARGET_AVX2 std::size_t scanValueAvx2(const uint16_t *a, std::size_t count, uint16_t value)
+{
+    __m256i needle = _mm256_set1_epi16(static_cast<short>(value));
+    std::size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i));
+        uint32_t mask = uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi16(x, needle)));
+        if (mask)
+            return i + std::countr_zero(mask) / 2;
+    }
+    return i + scanValueSse2(a + i, count - i, value);
+}
+
+LC3_TARGET_AVX2 std::size_t scanPairAvx2(const uint16_t *a, std::size_t count, uint16_t first, uint16_t second)
+{
+    __m256i needle0 = _mm256_set1_epi16(static_cast<short>(first));
+    __m256i needle1 = _mm256_set1_epi16(static_cast<short>(second));
+    std::size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m256i x0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i));
+        __m256i x1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i + 1));
+        __m256i hit = _mm256_and_si256(_mm256_cmpeq_epi16(x0, needle0), _mm256_cmpeq_epi16(x1, needle1));
+        uint32_t mask = uint32_t(_mm256_movemask_epi8(hit));
+        if (mask)
+            return i + std::countr_zero(mask) / 2;
+    }
+    return i + scanPairSse2(a + i, count - i, first, second);
+}
+
+bool cpuHasAvx2()
+{
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return false;
+    __cpuid(info, 1);
+    bool osxsave = info[2] & (1 << 27);
+    __cpuidex(info, 7, 0);
+    bool avx2 = info[1] & (1 << 5);
+    return osxsave && avx2 && (_xgetbv(0) & 6) == 6;
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif // LC3_SIMD_X86
+
+const Kernels &kernels()
+{
+    static const Kernels selected = [] {
+#ifdef LC3_SIMD_X86
+        if (cpuHasAvx2())
+            return Kernels{scanCompareAvx2, scanValueAvx2, scanPairAvx2, "AVX2"};
+        return Kernels{scanCompareSse2, scanValueSse2, scanPairSse2, "SSE2"};
+#else
+        return Kernels{scanCompareScalar, scanValueScalar, scanPairScalar, "scalar"};
+#endif
+    }();
+    return selected;
+}
+
+// Appends [start, start + length), merging with the previous range when they touch
+void appendRange(std::vector<LC3MemoryRange> &ranges, uint32_t start, uint32_t length)
+{
+    if (!ranges.empty() && ranges.back().start + ranges.back().length == start) {
+        ranges.back().length += length;
+    } else {
+        ranges.push_back({static_cast<uint16_t>(start), length});
+    }
+}
+
+void diffInto(std::vector<LC3MemoryRange> &ranges, const uint16_t *a, const uint16_t *b, std::size_t count, uint32_t base)
+{
+    const Kernels &k = kernels();
+    std::size_t i = 0;
+    while (i < count) {
+        i += k.scanCompare(a + i, b + i, count - i, false);
+        if (i == count)
+            break;
+        std::size_t end = i + k.scanCompare(a + i, b + i, count - i, true);
+        appendRange(ranges, base + i, end - i);
+        i = end;
+    }
+}
+
+std::vector<uint16_t> snapshotWords(const LC3Memory &memory)
+{
+    // One spare zero word so pair scans may read one past the end
+    std::vector<uint16_t> words(LC3Memory::Size + 1, 0);
+    memory.readBlock(0, std::span<uint16_t>(words.data(), LC3Memory::Size));
+    return words;
+}
+
+} // namespace
+
+std::vector<LC3MemoryRange> diffWords(const uint16_t *a, const uint16_t *b, std::size_t count, uint16_t base)
+{
+    std::vector<LC3MemoryRange> ranges;
+    diffInto(ranges, a, b, std::min(count, LC3Memory::Size - base), base);
+    return ranges;
+}
+
+std::vector<LC3MemoryRange> diffMemory(const LC3Memory &a, const LC3Memory &b)
+{
+    std::vector<LC3MemoryRange> ranges;
+    for (std::size_t page = 0; page < LC3Memory::PageCount; ++page) {
+        const uint16_t *x = a.pageData(page);
+        const uint16_t *y = b.pageData(page);
+        if (x != y)
+            diffInto(ranges, x, y, LC3Memory::PageSize, page << LC3Memory::PageBits);
+    }
+    return ranges;
+}
+
+std::vector<LC3MemoryRange> diffMemory(const LC3Memory &memory, const LC3MemoryImage &snapshot)
+{
+    std::vector<LC3MemoryRange> ranges;
+    for (std::size_t page = 0; page < LC3Memory::PageCount; ++page) {
+        const std::shared_ptr<LC3Memory::Page> &saved = snapshot.page(page);
+        const uint16_t *x = memory.pageData(page);
+        const uint16_t *y = saved ? saved->data() : LC3Memory::zeroPage()->data();
+        if (x != y)
+            diffInto(ranges, x, y, LC3Memory::PageSize, page << LC3Memory::PageBits);
+    }
+    return ranges;
+}
+
+std::vector<uint16_t> findValue(const LC3Memory &memory, uint16_t value, std::size_t maxResults)
+{
+    const Kernels &k = kernels();
+    std::vector<uint16_t> hits;
+    for (std::size_t page = 0; page < LC3Memory::PageCount && hits.size() < maxResults; ++page) {
+        const uint16_t *words = memory.pageData(page);
+        std::size_t i = 0;
+        while (hits.size() < maxResults) {
+            i += k.scanValue(words + i, LC3Memory::PageSize - i, value);
+            if (i == LC3Memory::PageSize)
+                break;
+            hits.push_back(static_cast<uint16_t>((page << LC3Memory::PageBits) + i));
+            ++i;
+        }
+    }
+    return hits;
+}
+
+std::vector<uint16_t> findPattern(const LC3Memory &memory, std::span<const uint16_t> pattern, std::size_t maxResults)
+{
+    if (pattern.empty() || pattern.size() > LC3Memory::Size)
+        return {};
+    if (pattern.size() == 1)
+        return findValue(memory, pattern[0], maxResults);
+
+    // Patterns may straddle pages, so search one contiguous copy
+    const Kernels &k = kernels();
+    std::vector<uint16_t> words = snapshotWords(memory);
+    std::size_t positions = LC3Memory::Size - pattern.size() + 1;
+    std::vector<uint16_t> hits;
+    std::size_t i = 0;
+    while (hits.size() < maxResults) {
+        i += k.scanPair(words.data() + i, positions - i, pattern[0], pattern[1]);
+        if (i >= positions)
+            break;
+        if (std::memcmp(words.data() + i + 2, pattern.data() + 2, (pattern.size() - 2) * sizeof(uint16_t)) == 0)
+            hits.push_back(static_cast<uint16_t>(i));
+        ++i;
+    }
+    return hits;
+}
+
+const char *memorySearchIsa()
+{
+    return kernels().name;
+}
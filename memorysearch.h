@@ -0,0 +1,31 @@
+#ifndef MEMORYSEARCH_H
+#define MEMORYSEARCH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+#include "lc3memory.h"
+
+// Vectorised memory comparison and search. On x86 the kernels use AVX2 when the
+// CPU has it and SSE2 otherwise (picked once at startup); other targets fall back
+// to plain loops.
+
+// Ranges of addresses whose words differ. base is the address of a[0] and b[0].
+std::vector<LC3MemoryRange> diffWords(const uint16_t *a, const uint16_t *b, std::size_t count, uint16_t base = 0);
+
+// Whole-memory diffs, a page at a time. Pages two paged memories (or a memory and
+// a snapshot) still share are skipped without being read.
+std::vector<LC3MemoryRange> diffMemory(const LC3Memory &a, const LC3Memory &b);
+std::vector<LC3MemoryRange> diffMemory(const LC3Memory &memory, const LC3MemoryImage &snapshot);
+
+// Addresses at which value, or the multi-word pattern, starts. Patterns do not wrap
+// around xFFFF. At most maxResults addresses are returned.
+std::vector<uint16_t> findValue(const LC3Memory &memory, uint16_t value, std::size_t maxResults = LC3Memory::Size);
+std::vector<uint16_t> findPattern(const LC3Memory &memory, std::span<const uint16_t> pattern,
+                                  std::size_t maxResults = LC3Memory::Size);
+
+// Name of the kernel set in use ("AVX2", "SSE2" or "scalar")
+const char *memorySearchIsa();
+
+#endif // MEMORYSEARCH_H
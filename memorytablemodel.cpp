@@ -1,62 +1,125 @@
 #include "memorytablemodel.h"
-MemoryTableModel::MemoryTableModel(QObject *parent)
-    : QAbstractTableModel(parent), m_memory(0xFFFF)
+#include "lc3isa.h"
+#include <QBrush>
+#include <QColor>
+#include <algorithm>
+
+MemoryTableModel::MemoryTableModel(const LC3Memory &memory, QObject *parent)
+    : QAbstractTableModel(parent), memory(memory)
 {
 }
 
 int MemoryTableModel::rowCount(const QModelIndex &parent) const
 {
-    Q_UNUSED(parent);
-    return m_memory.size();
+    return parent.isValid() ? 0 : int(LC3Memory::Size); // x0000 - xFFFF
 }
 
 int MemoryTableModel::columnCount(const QModelIndex &parent) const
 {
-    Q_UNUSED(parent);
-    return 2; // Address and Value columns
+    return parent.isValid() ? 0 : ColumnCount;
 }
 
 QVariant MemoryTableModel::data(const QModelIndex &index, int role) const
 {
-    if (!index.isValid() || role != Qt::DisplayRole)
+    if (!index.isValid())
         return QVariant();
 
-    int row = index.row();
-    int col = index.column();
-
-    if (col == 0)
-    {
-        // Address column
-        return QString("0x%1").arg(row, 4, 16, QChar('0')).toUpper();
-    }
-    else if (col == 1)
+    uint16_t address = static_cast<uint16_t>(index.row());
+    switch (role)
     {
-        // Value column
-        return QString("0x%1").arg(m_memory[row], 4, 16, QChar('0')).toUpper();
+    case Qt::DisplayRole:
+        if (index.column() == AddressColumn)
+            return QString("0x%1").arg(address, 4, 16, QChar('0')).toUpper();
+        if (index.column() == ValueColumn)
+            return QString("0x%1").arg(memory.read(address), 4, 16, QChar('0')).toUpper();
+        if (index.column() == DisassemblyColumn)
+            return disassembly(address);
+        if (index.column() == LabelColumn)
+        {
+            const AsmSymbol *symbol = labels.symbolAt(address);
+            return symbol ? QString::fromUtf8(symbol->name.data(), qsizetype(symbol->name.size())) : QString();
+        }
+        break;
+    case Qt::TextAlignmentRole:
+        if (index.column() == DisassemblyColumn || index.column() == LabelColumn)
+            return int(Qt::AlignLeft | Qt::AlignVCenter);
+        return int(Qt::AlignCenter);
+    case Qt::BackgroundRole:
+        if (isHighlighted(address))
+            return QBrush(QColor("#ffd54f"));
+        break;
     }
-
     return QVariant();
 }
 
 QVariant MemoryTableModel::headerData(int section, Qt::Orientation orientation, int role) const
 {
-    if (role != Qt::DisplayRole)
+    if (role != Qt::DisplayRole || orientation != Qt::Horizontal)
         return QVariant();
 
-    if (orientation == Qt::Horizontal)
+    switch (section)
     {
-        if (section == 0)
-            return QString("Address");
-        else if (section == 1)
-            return QString("Value");
+    case AddressColumn: return QString("Address");
+    case LabelColumn: return QString("Label");
+    case ValueColumn: return QString("Value");
+    case DisassemblyColumn: return QString("Disassembly");
     }
-
     return QVariant();
 }
 
-void MemoryTableModel::setMemory(const std::vector<uint16_t> &memory)
+void MemoryTableModel::wordsChanged(std::span<const LC3MemoryRange> ranges)
+{
+    // Addresses and labels do not change with memory. Cached disassembly is
+    // checked against the word when next drawn, so nothing is dropped here.
+    emitRowsChanged(ranges, ValueColumn, Qt::DisplayRole);
+}
+
+void MemoryTableModel::setLabels(const AsmSymbolTable &symbols)
+{
+    labels = symbols;
+    emit dataChanged(index(0, LabelColumn), index(int(LC3Memory::Size) - 1, LabelColumn), {Qt::DisplayRole});
+}
+
+void MemoryTableModel::setHighlightedRanges(const std::vector<LC3MemoryRange> &ranges)
+{
+    std::vector<LC3MemoryRange> previous = std::move(highlighted);
+    highlighted = ranges;
+    emitRowsChanged(previous, AddressColumn, Qt::BackgroundRole);
+    emitRowsChanged(highlighted, AddressColumn, Qt::BackgroundRole);
+}
+
+const QString &MemoryTableModel::disassembly(uint16_t address) const
 {
-    beginResetModel();
-    m_memory = memory;
-    endResetModel();
+    std::unique_ptr<DecodedPage> &page = decoded[address >> LC3Memory::PageBits];
+    if (!page)
+        page = std::make_unique<DecodedPage>();
+
+    DecodedWord &entry = (*page)[address & LC3Memory::PageMask];
+    uint16_t word = memory.read(address);
+    if (!entry.decoded || entry.word != word)
+    {
+        entry.decoded = true;
+        entry.word = word;
+        entry.text = QString::fromStdString(lc3Disassemble(word, address));
+    }
+    return entry.text;
+}
+
+bool MemoryTableModel::isHighlighted(uint16_t address) const
+{
+    // The last range starting at or before address
+    auto it = std::upper_bound(highlighted.begin(), highlighted.end(), address,
+                               [](uint16_t value, const LC3MemoryRange &range) { return value < range.start; });
+    return it != highlighted.begin() && address - std::prev(it)->start < std::prev(it)->length;
+}
+
+void MemoryTableModel::emitRowsChanged(std::span<const LC3MemoryRange> ranges, int firstColumn, int role)
+{
+    for (const LC3MemoryRange &range : ranges)
+    {
+        if (range.length == 0)
+            continue;
+        int last = int(range.start + range.length - 1);
+        emit dataChanged(index(range.start, firstColumn), index(last, ColumnCount - 1), {role});
+    }
 }
@@ -1,22 +1,63 @@
-// memorytablemodel.h
+#ifndef MEMORYTABLEMODEL_H
+#define MEMORYTABLEMODEL_H
+
+#include "asmsymbols.h"
+#include "lc3memory.h"
 #include <QAbstractTableModel>
-#include <vector>
+#include <QString>
+#include <array>
 #include <cstdint>
+#include <memory>
+#include <span>
+#include <vector>
 
+// The memory table's model: one row per address, read straight from the live
+// LC3Memory whenever the view asks for a cell, so nothing is copied or
+// allocated up front and the view only ever formats the rows on screen.
+// Disassembly is decoded the first time a row is drawn and cached with the word
+// it was decoded from; the cache is allocated a page at a time as rows are
+// scrolled into view.
 class MemoryTableModel : public QAbstractTableModel
 {
     Q_OBJECT
 
 public:
-    MemoryTableModel(QObject *parent = nullptr);
+    enum Column { AddressColumn, LabelColumn, ValueColumn, DisassemblyColumn, ColumnCount };
+
+    explicit MemoryTableModel(const LC3Memory &memory, QObject *parent = nullptr);
 
     int rowCount(const QModelIndex &parent = QModelIndex()) const override;
     int columnCount(const QModelIndex &parent = QModelIndex()) const override;
     QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
     QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
 
-    void setMemory(const std::vector<uint16_t> &memory);
+    // Called with the ranges LC3Memory::publishChanges() reports; emits one
+    // dataChanged per range, so the view repaints only written rows on screen
+    void wordsChanged(std::span<const LC3MemoryRange> ranges);
+
+    // Labels of the loaded program, for the Label column; an empty table clears it
+    void setLabels(const AsmSymbolTable &symbols);
+
+    // Rows drawn with the highlight colour (Diff results); replaces the last set
+    void setHighlightedRanges(const std::vector<LC3MemoryRange> &ranges);
 
 private:
-    std::vector<uint16_t> m_memory;
+    struct DecodedWord
+    {
+        bool decoded = false;
+        uint16_t word = 0; // The word text was decoded from
+        QString text;
+    };
+    using DecodedPage = std::array<DecodedWord, LC3Memory::PageSize>;
+
+    const QString &disassembly(uint16_t address) const;
+    bool isHighlighted(uint16_t address) const;
+    void emitRowsChanged(std::span<const LC3MemoryRange> ranges, int firstColumn, int role);
+
+    const LC3Memory &memory;
+    AsmSymbolTable labels;
+    mutable std::array<std::unique_ptr<DecodedPage>, LC3Memory::PageCount> decoded;
+    std::vector<LC3MemoryRange> highlighted; // Sorted by start, as diffMemory returns them
 };
+
+#endif // MEMORYTABLEMODEL_H
@@ -0,0 +1,8 @@
+# Unit tests for the core library. Build and run with: qmake && make check
+TEMPLATE = subdirs
+
+SUBDIRS = \
+    tst_asmpeephole \
+    tst_asmsections \
+    tst_incrementalassembler \
+    tst_lc3object
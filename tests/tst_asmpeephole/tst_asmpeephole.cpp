@@ -0,0 +1,134 @@
+#include "asmpeephole.h"
+#include "asmsections.h"
+#include "lc3machine.h"
+#include <QtTest>
+#include <span>
+
+class TestAsmPeephole : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void nothingToOptimize();
+    void optimizedProgramBehavesTheSame();
+};
+
+// The first address at which the two memories differ, or -1
+static int firstDifference(const LC3Memory &a, const LC3Memory &b)
+{
+    for (std::size_t page = 0; page < LC3Memory::PageCount; ++page)
+    {
+        const uint16_t *left = a.pageData(page);
+        const uint16_t *right = b.pageData(page);
+        for (std::size_t word = 0; word < LC3Memory::PageSize; ++word)
+        {
+            if (left[word] != right[word])
+                return static_cast<int>(page * LC3Memory::PageSize + word);
+        }
+    }
+    return -1;
+}
+
+// Runs image from x3000 until HALT; executed counts the instructions
+static LC3Machine::Status run(LC3Machine &machine, const LC3Memory &image, uint64_t &executed)
+{
+    for (std::size_t page = 0; page < LC3Memory::PageCount; ++page)
+        machine.memory().writeBlock(page * LC3Memory::PageSize, std::span(image.pageData(page), LC3Memory::PageSize));
+    machine.registers().setPC(0x3000);
+    return machine.run(10000, executed);
+}
+
+// With nothing to rewrite, -O must build exactly what the plain build does
+void TestAsmPeephole::nothingToOptimize()
+{
+    const std::string_view source = "ORG x3000\n"
+                                    "LD R0, COUNT\n"
+                                    "AND R1, R1, #0\n"
+                                    "LOOP, ADD R1, R1, R0\n"
+                                    "ADD R0, R0, #-1\n"
+                                    "BRp LOOP\n"
+                                    "ST R1, RESULT\n"
+                                    "JSR DOUBLE\n"
+                                    "HALT\n"
+                                    "COUNT, DEC 4\n"
+                                    "RESULT, DEC 0\n"
+                                    "ORG x3100\n"
+                                    "DOUBLE, ADD R1, R1, R1\n"
+                                    "RET\n"
+                                    "END\n";
+
+    AsmDiagnostics diagnostics;
+    AsmDiagnosticCollector collect(diagnostics);
+
+    QStringList report;
+    AsmSymbolTable optimizedLabels;
+    LC3Memory optimized(LC3Memory::Layout::Paged);
+    uint32_t optimizedEnd = assembleOptimized(source, optimizedLabels, optimized, report);
+
+    AsmSymbolTable plainLabels;
+    LC3Memory plain(LC3Memory::Layout::Paged);
+    uint32_t plainEnd = assembleParallel(source, plainLabels, plain);
+
+    QVERIFY(diagnostics.isEmpty());
+    QVERIFY(report.isEmpty());
+    QCOMPARE(firstDifference(optimized, plain), -1);
+    QCOMPARE(optimizedEnd, plainEnd);
+    QCOMPARE(optimizedLabels.size(), plainLabels.size());
+    for (const AsmSymbol &symbol : plainLabels)
+        QCOMPARE(optimizedLabels.value(symbol.name, 0xFFFF), symbol.address);
+}
+
+// One chance for each rewrite. The images differ, so both are run and must end
+// with the same registers and result, the optimized one in fewer instructions.
+void TestAsmPeephole::optimizedProgramBehavesTheSame()
+{
+    const std::string_view source = "LD R1, VALUE\n"
+                                    "ST R1, SAVED\n"
+                                    "LD R1, SAVED\n"
+                                    "ADD R1, R1, #1\n"
+                                    "ADD R1, R1, #2\n"
+                                    "AND R2, R2, #0\n"
+                                    "ADD R2, R1, #0\n"
+                                    "BRp SKIP\n"
+                                    "ADD R3, R3, #1\n"
+                                    "SKIP, BRnzp DONE\n"
+                                    "ADD R4, R4, #1\n"
+                                    "DONE, ST R2, RESULT\n"
+                                    "HALT\n"
+                                    "VALUE, DEC 7\n"
+                                    "SAVED, DEC 0\n"
+                                    "RESULT, DEC 0\n";
+
+    AsmDiagnostics diagnostics;
+    AsmDiagnosticCollector collect(diagnostics);
+
+    QStringList report;
+    AsmSymbolTable optimizedLabels;
+    LC3Memory optimized(LC3Memory::Layout::Paged);
+    assembleOptimized(source, optimizedLabels, optimized, report);
+
+    AsmSymbolTable plainLabels;
+    LC3Memory plain(LC3Memory::Layout::Paged);
+    assembleParallel(source, plainLabels, plain);
+
+    QVERIFY(diagnostics.isEmpty());
+    QCOMPARE(report.size(), 4);
+
+    LC3Machine optimizedMachine;
+    LC3Machine plainMachine;
+    uint64_t optimizedExecuted = 0;
+    uint64_t plainExecuted = 0;
+    QCOMPARE(run(optimizedMachine, optimized, optimizedExecuted), LC3Machine::Status::Halted);
+    QCOMPARE(run(plainMachine, plain, plainExecuted), LC3Machine::Status::Halted);
+    QVERIFY(optimizedExecuted < plainExecuted);
+
+    for (uint8_t r = 0; r < 8; ++r)
+        QCOMPARE(optimizedMachine.registers().getR(r), plainMachine.registers().getR(r));
+    QCOMPARE(optimizedMachine.registers().getCC(), plainMachine.registers().getCC());
+    QCOMPARE(optimizedMachine.memory().read(optimizedLabels.value("RESULT")), uint16_t(10));
+    QCOMPARE(plainMachine.memory().read(plainLabels.value("RESULT")), uint16_t(10));
+}
+
+QTEST_APPLESS_MAIN(TestAsmPeephole)
+
+#include "tst_asmpeephole.moc"
@@ -0,0 +1,7 @@
+QT = core concurrent testlib
+CONFIG += c++20 testcase console
+CONFIG -= app_bundle
+
+include(../../lc3core.pri)
+
+SOURCES += tst_asmpeephole.cpp
@@ -0,0 +1,133 @@
+#include "asmsections.h"
+#include <QThreadPool>
+#include <QtTest>
+#include <cstdio>
+#include <string>
+
+class TestAsmSections : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void crossSectionReferences();
+    void generatedSections();
+};
+
+// The first address at which the two memories differ, or -1
+static int firstDifference(const LC3Memory &a, const LC3Memory &b)
+{
+    for (std::size_t page = 0; page < LC3Memory::PageCount; ++page)
+    {
+        const uint16_t *left = a.pageData(page);
+        const uint16_t *right = b.pageData(page);
+        for (std::size_t word = 0; word < LC3Memory::PageSize; ++word)
+        {
+            if (left[word] != right[word])
+                return static_cast<int>(page * LC3Memory::PageSize + word);
+        }
+    }
+    return -1;
+}
+
+// Builds source with assembleParallel, assembleSinglePass and the two-pass
+// assembler and checks that all three agree word for word
+static void compareBuilds(const std::string &source)
+{
+    AsmDiagnostics diagnostics;
+    AsmDiagnosticCollector collect(diagnostics);
+
+    AsmSymbolTable parallelLabels;
+    LC3Memory parallel(LC3Memory::Layout::Paged);
+    uint32_t parallelEnd = assembleParallel(source, parallelLabels, parallel);
+
+    AsmSymbolTable singleLabels;
+    LC3Memory single(LC3Memory::Layout::Paged);
+    uint32_t singleEnd = assembleSinglePass(source, singleLabels, single);
+
+    AsmSymbolTable twoPassLabels = processLabels(source);
+    LC3Memory twoPass(LC3Memory::Layout::Paged);
+    assembleInstructionSetA(source, twoPassLabels, twoPass);
+
+    QVERIFY(diagnostics.isEmpty());
+    QCOMPARE(firstDifference(parallel, single), -1);
+    QCOMPARE(firstDifference(parallel, twoPass), -1);
+    QCOMPARE(parallelEnd, singleEnd);
+    QCOMPARE(parallelLabels.size(), singleLabels.size());
+    for (const AsmSymbol &symbol : singleLabels)
+    {
+        QCOMPARE(parallelLabels.value(symbol.name, 0xFFFF), symbol.address);
+        QCOMPARE(twoPassLabels.value(symbol.name, 0xFFFF), symbol.address);
+    }
+}
+
+void TestAsmSections::initTestCase()
+{
+    // With one thread assembleParallel goes straight to assembleSinglePass
+    if (QThreadPool::globalInstance()->maxThreadCount() < 2)
+        QThreadPool::globalInstance()->setMaxThreadCount(2);
+}
+
+// Sections that load from, branch into and call each other, a label on an ORG
+// line, block directives, and text after END that no section may emit
+void TestAsmSections::crossSectionReferences()
+{
+    compareBuilds("ORG x3000\n"
+                  "LD R0, COUNT\n"
+                  "LEA R1, TABLE\n"
+                  "JSR SUM\n"
+                  "ST R2, RESULT\n"
+                  "HALT\n"
+                  "DONE, ORG x3080\n"
+                  "COUNT, DEC 3\n"
+                  "TABLE, .BLKW 3\n"
+                  "RESULT, DEC 0\n"
+                  "NAME, .STRINGZ \"sum\"\n"
+                  "ORG x3100\n"
+                  "SUM, AND R2, R2, #0\n"
+                  "NEXT, LDR R3, R1, #0\n"
+                  "ADD R2, R2, R3\n"
+                  "ADD R1, R1, #1\n"
+                  "ADD R0, R0, #-1\n"
+                  "BRp NEXT\n"
+                  "RET\n"
+                  "ORG x3300\n"
+                  "FAR, HEX 0x1234\n"
+                  "JSR SUM\n"
+                  "END\n"
+                  "ORG x4000\n"
+                  "ADD R0, R0, #1\n");
+}
+
+// Enough sections of ordinary code that the pool runs several at once, each
+// branching back to its own labels and calling into the next section
+void TestAsmSections::generatedSections()
+{
+    constexpr unsigned Sections = 8;
+    constexpr unsigned SectionWords = 0x200;
+
+    std::string source;
+    char org[16];
+    for (unsigned section = 0; section < Sections; ++section)
+    {
+        std::snprintf(org, sizeof org, "ORG x%X\n", 0x3000 + section * SectionWords);
+        source += org;
+        for (unsigned word = 0; word < SectionWords - 1; ++word)
+        {
+            std::string label = "S" + std::to_string(section) + "L" + std::to_string(word / 16);
+            if (word % 16 == 0)
+                source += label + ", ";
+            source += word % 4 == 0   ? "ADD R1, R1, #1\n"
+                      : word % 4 == 1 ? "BRz " + label + "\n"
+                      : word % 4 == 2 ? "LD R2, " + label + "\n"
+                                      : "NOT R3, R2\n";
+        }
+        source += section + 1 < Sections ? "JSR S" + std::to_string(section + 1) + "L0\n" : "HALT\n";
+    }
+    source += "END\n";
+    compareBuilds(source);
+}
+
+QTEST_APPLESS_MAIN(TestAsmSections)
+
+#include "tst_asmsections.moc"
@@ -0,0 +1,184 @@
+#include "AssemblerLogic.h"
+#include "incrementalassembler.h"
+#include <QtTest>
+#include <string>
+
+class TestIncrementalAssembler : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void editsMatchFullAssembly();
+    void brokenLineRecovers();
+};
+
+// The first address at which the two memories differ, or -1
+static int firstDifference(const LC3Memory &a, const LC3Memory &b)
+{
+    for (std::size_t page = 0; page < LC3Memory::PageCount; ++page)
+    {
+        const uint16_t *left = a.pageData(page);
+        const uint16_t *right = b.pageData(page);
+        for (std::size_t word = 0; word < LC3Memory::PageSize; ++word)
+        {
+            if (left[word] != right[word])
+                return static_cast<int>(page * LC3Memory::PageSize + word);
+        }
+    }
+    return -1;
+}
+
+// Checks the incremental image, end address and labels against a fresh
+// single-pass build of the same text
+static void compareWithFullAssembly(const IncrementalAssembler &incremental, const std::string &source)
+{
+    AsmSymbolTable expected;
+    LC3Memory memory(LC3Memory::Layout::Paged);
+    uint32_t endAddress = assembleSinglePass(source, expected, memory);
+
+    QVERIFY(incremental.isClean());
+    QCOMPARE(firstDifference(incremental.image(), memory), -1);
+    QCOMPARE(incremental.endAddress(), endAddress);
+
+    AsmSymbolTable labels;
+    incremental.labels(labels);
+    QCOMPARE(labels.size(), expected.size());
+    for (const AsmSymbol &symbol : expected)
+        QCOMPARE(labels.value(symbol.name, 0xFFFF), symbol.address);
+}
+
+// Each step edits the one before: a line inserted ahead of the labels, a line
+// deleted, a second ORG section, then END moved in front of that section
+void TestIncrementalAssembler::editsMatchFullAssembly()
+{
+    const std::string steps[] = {
+        "ORG x3000\n"
+        "LD R0, COUNT\n"
+        "LOOP, ADD R1, R1, R0\n"
+        "ADD R0, R0, #-1\n"
+        "BRp LOOP\n"
+        "ST R1, SUM\n"
+        "HALT\n"
+        "COUNT, DEC 5\n"
+        "SUM, DEC 0\n"
+        "END\n",
+
+        "ORG x3000\n"
+        "LD R0, COUNT\n"
+        "LEA R2, MESSAGE\n"
+        "LOOP, ADD R1, R1, R0\n"
+        "ADD R0, R0, #-1\n"
+        "BRp LOOP\n"
+        "ST R1, SUM\n"
+        "HALT\n"
+        "COUNT, DEC 5\n"
+        "SUM, DEC 0\n"
+        "MESSAGE, .STRINGZ \"Sum\"\n"
+        "END\n",
+
+        "ORG x3000\n"
+        "LD R0, COUNT\n"
+        "LEA R2, MESSAGE\n"
+        "LOOP, ADD R1, R1, R0\n"
+        "BRp LOOP\n"
+        "ST R1, SUM\n"
+        "HALT\n"
+        "COUNT, DEC 5\n"
+        "SUM, DEC 0\n"
+        "MESSAGE, .STRINGZ \"Sum\"\n"
+        "END\n",
+
+        "ORG x3000\n"
+        "LD R0, COUNT\n"
+        "LEA R2, MESSAGE\n"
+        "LOOP, ADD R1, R1, R0\n"
+        "BRp LOOP\n"
+        "ST R1, SUM\n"
+        "HALT\n"
+        "COUNT, DEC 5\n"
+        "SUM, DEC 0\n"
+        "MESSAGE, .STRINGZ \"Sum\"\n"
+        "ORG x4000\n"
+        "BUFFER, .BLKW 3\n"
+        "JSR HELPER\n"
+        "HELPER, RET\n"
+        "END\n",
+
+        "ORG x3000\n"
+        "LD R0, COUNT\n"
+        "LEA R2, MESSAGE\n"
+        "LOOP, ADD R1, R1, R0\n"
+        "BRp LOOP\n"
+        "ST R1, SUM\n"
+        "HALT\n"
+        "COUNT, DEC 5\n"
+        "SUM, DEC 0\n"
+        "MESSAGE, .STRINGZ \"Sum\"\n"
+        "END\n"
+        "ORG x4000\n"
+        "BUFFER, .BLKW 3\n"
+        "JSR HELPER\n"
+        "HELPER, RET\n",
+    };
+
+    AsmDiagnostics diagnostics;
+    AsmDiagnosticCollector collect(diagnostics);
+    IncrementalAssembler incremental;
+    for (const std::string &source : steps)
+    {
+        incremental.update(source);
+        compareWithFullAssembly(incremental, source);
+        if (QTest::currentTestFailed())
+            return;
+    }
+    QVERIFY(diagnostics.isEmpty());
+}
+
+// A rejected line and an undefined label each leave the image unclean; undoing
+// the edit must bring back exactly the full build
+void TestIncrementalAssembler::brokenLineRecovers()
+{
+    const std::string good = "LD R0, COUNT\n"
+                             "LOOP, ADD R1, R1, R0\n"
+                             "ADD R0, R0, #-1\n"
+                             "BRp LOOP\n"
+                             "HALT\n"
+                             "COUNT, DEC 5\n";
+    const std::string badImmediate = "LD R0, COUNT\n"
+                                     "LOOP, ADD R1, R1, R0\n"
+                                     "ADD R0, R0, #99\n"
+                                     "BRp LOOP\n"
+                                     "HALT\n"
+                                     "COUNT, DEC 5\n";
+    const std::string undefinedLabel = "LD R0, COUNT\n"
+                                       "ADD R1, R1, R0\n"
+                                       "ADD R0, R0, #-1\n"
+                                       "BRp LOOP\n"
+                                       "HALT\n"
+                                       "COUNT, DEC 5\n";
+
+    AsmDiagnostics diagnostics;
+    AsmDiagnosticCollector collect(diagnostics);
+    IncrementalAssembler incremental;
+    incremental.update(good);
+    compareWithFullAssembly(incremental, good);
+    if (QTest::currentTestFailed())
+        return;
+
+    for (const std::string &broken : {badImmediate, undefinedLabel})
+    {
+        incremental.update(broken);
+        QVERIFY(!incremental.isClean());
+        QVERIFY(!incremental.diagnostics().isEmpty());
+
+        incremental.update(good);
+        compareWithFullAssembly(incremental, good);
+        if (QTest::currentTestFailed())
+            return;
+        QVERIFY(incremental.diagnostics().isEmpty());
+    }
+}
+
+QTEST_APPLESS_MAIN(TestIncrementalAssembler)
+
+#include "tst_incrementalassembler.moc"
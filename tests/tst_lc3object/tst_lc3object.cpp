@@ -0,0 +1,43 @@
+#include "lc3object.h"
+#include <QtTest>
+
+class TestLC3Object : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void labelOnOrgLine();
+};
+
+// "LAST, ORG x4000" defines LAST at the end of the section before the ORG. Here
+// that is the relocatable section, so the linker has to add the module's base.
+void TestLC3Object::labelOnOrgLine()
+{
+    AsmDiagnostics diagnostics;
+    AsmDiagnosticCollector collect(diagnostics);
+
+    LC3Object first = assembleObject("ADD R1, R1, #1\nADD R1, R1, #1\nADD R1, R1, #1\n", "first.asm");
+    LC3Object second = assembleObject("EXPORT LAST\n"
+                                      "BRnzp LAST\n"
+                                      "ADD R1, R1, #1\n"
+                                      "ADD R1, R1, #2\n"
+                                      "LAST, ORG x4000\n"
+                                      "HALT\n",
+                                      "second.asm");
+    QVERIFY(first.errors.isEmpty());
+    QVERIFY(second.errors.isEmpty());
+
+    AsmSymbolTable labels;
+    LC3Memory memory(LC3Memory::Layout::Paged);
+    linkObjects({&first, &second}, labels, memory);
+    QVERIFY(diagnostics.isEmpty());
+
+    // second.asm is placed after the three words of first.asm
+    QCOMPARE(labels.value("LAST"), uint16_t(0x3006));
+    QCOMPARE(memory.read(0x3003), uint16_t(0x0E02)); // BRnzp to x3006
+    QCOMPARE(memory.read(0x4000), uint16_t(0xF025));
+}
+
+QTEST_APPLESS_MAIN(TestLC3Object)
+
+#include "tst_lc3object.moc"